@@ -0,0 +1,179 @@
+#pragma once
+
+#include <benchmark/benchmark.h>
+#include "balancer.h"
+#include "parser.h"
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+    // number of config elements applied between two pauses of the timer
+    constexpr usize ELEMENTS_PER_ROUND = 4096;
+
+    std::string person_name(usize i) {
+        return "person" + std::to_string(i);
+    }
+
+    std::string currency_name(usize i) {
+        return "currency" + std::to_string(i);
+    }
+
+    /**
+     * State with the people split into groups of the given size and the given number of currencies.
+     */
+    BalancingState make_state(usize people, usize groupSize, usize currencies) {
+        BalancingState state;
+        for (usize i = 0; i < people; i++)
+            advance_state(model::Person(person_name(i), {}), state);
+        for (usize g = 0; g * groupSize < people; g++) {
+            std::vector<std::string> members;
+            for (usize i = g * groupSize; i < std::min(people, (g + 1) * groupSize); i++)
+                members.push_back(person_name(i));
+            advance_state(model::Group("group" + std::to_string(g), std::move(members)), state);
+        }
+        for (usize c = 0; c < currencies; c++)
+            advance_state(model::Currency(currency_name(c)), state);
+        return state;
+    }
+
+    /**
+     * Apply the elements created by the supplied function in rounds, the creation itself is not measured.
+     * @tparam Make function creating the i-th element
+     */
+    template<typename Make>
+    void apply_elements(benchmark::State &benchState, BalancingState &state, Make &&make) {
+        usize created = 0;
+        std::vector<model::ConfigElement> elements;
+        for (auto _ : benchState) {
+            benchState.PauseTiming();
+            elements.clear();
+            for (usize i = 0; i < ELEMENTS_PER_ROUND; i++)
+                elements.push_back(make(created++));
+            benchState.ResumeTiming();
+
+            for (auto &element : elements)
+                advance_state(std::move(element), state);
+        }
+        benchState.SetItemsProcessed(benchState.iterations() * ELEMENTS_PER_ROUND);
+    }
+}
+
+static void BM_AdvanceStatePerson(benchmark::State &benchState) {
+    auto state = make_state(benchState.range(0), 1, 1);
+    apply_elements(benchState, state, [](usize i) -> model::ConfigElement {
+        return model::Person("new" + std::to_string(i), {"alias" + std::to_string(i)});
+    });
+}
+
+BENCHMARK(BM_AdvanceStatePerson)->Arg(1000)->Arg(100000);
+
+static void BM_AdvanceStateGroup(benchmark::State &benchState) {
+    const usize people = benchState.range(0);
+    const usize groupSize = benchState.range(1);
+    auto state = make_state(people, groupSize, 1);
+    std::mt19937_64 random(42);
+    apply_elements(benchState, state, [&](usize i) -> model::ConfigElement {
+        std::vector<std::string> members;
+        for (usize m = 0; m < groupSize; m++)
+            members.push_back(person_name(random() % people));
+        return model::Group("new" + std::to_string(i), std::move(members));
+    });
+}
+
+BENCHMARK(BM_AdvanceStateGroup)->Args({10000, 4})->Args({10000, 64});
+
+static void BM_AdvanceStateCurrency(benchmark::State &benchState) {
+    auto state = make_state(100, 10, benchState.range(0));
+    apply_elements(benchState, state, [](usize i) -> model::ConfigElement {
+        return model::Currency("new" + std::to_string(i));
+    });
+}
+
+BENCHMARK(BM_AdvanceStateCurrency)->Arg(1)->Arg(1000);
+
+/**
+ * Arguments are the number of people, size of the groups and number of currencies. Every transaction is paid by
+ * a single person for a whole group in a random currency.
+ */
+static void BM_AdvanceStateTransaction(benchmark::State &benchState) {
+    const usize people = benchState.range(0);
+    const usize groupSize = benchState.range(1);
+    const usize currencies = benchState.range(2);
+    auto state = make_state(people, groupSize, currencies);
+    const usize groups = state.people.get_number_of_groups();
+    std::mt19937_64 random(42);
+    apply_elements(benchState, state, [&](usize) -> model::ConfigElement {
+        return model::Transaction({person_name(random() % people)},
+                                  {(double) (random() % 100000) / 100, currency_name(random() % currencies)},
+                                  {"group" + std::to_string(random() % groups)});
+    });
+}
+
+BENCHMARK(BM_AdvanceStateTransaction)
+        ->Args({100, 1, 1})->Args({100, 10, 1})
+        ->Args({100000, 1, 1})->Args({100000, 100, 1})->Args({100000, 100, 100});
+
+/**
+ * Transactions between several people at once, so that they have to be deduplicated.
+ */
+static void BM_AdvanceStateTransactionMany(benchmark::State &benchState) {
+    const usize people = benchState.range(0);
+    const usize groupSize = benchState.range(1);
+    auto state = make_state(people, groupSize, 1);
+    const usize groups = state.people.get_number_of_groups();
+    std::mt19937_64 random(42);
+    apply_elements(benchState, state, [&](usize) -> model::ConfigElement {
+        return model::Transaction({person_name(random() % people), person_name(random() % people)},
+                                  {(double) (random() % 100000) / 100, currency_name(0)},
+                                  {"group" + std::to_string(random() % groups),
+                                   "group" + std::to_string(random() % groups)});
+    });
+}
+
+BENCHMARK(BM_AdvanceStateTransactionMany)->Args({10000, 1})->Args({10000, 100});
+
+static void BM_IDRegisterLookup(benchmark::State &benchState) {
+    const usize people = benchState.range(0);
+    auto state = make_state(people, 10, 1);
+    std::vector<std::string> names;
+    std::mt19937_64 random(42);
+    for (usize i = 0; i < 1024; i++)
+        names.push_back(i % 2 ? person_name(random() % people) : "group" + std::to_string(random() % (people / 10)));
+
+    usize i = 0;
+    for (auto _ : benchState) {
+        auto const &name = names[i++ % names.size()];
+        benchmark::DoNotOptimize(state.people.find_person(name));
+        benchmark::DoNotOptimize(state.people.find_group(name));
+    }
+}
+
+BENCHMARK(BM_IDRegisterLookup)->Arg(1000)->Arg(1000000);
+
+/**
+ * Record a chain of conversions through all the currencies and settle the balances, which moves them along the chain.
+ */
+static void BM_CurrencyTransformation(benchmark::State &benchState) {
+    const usize people = benchState.range(0);
+    const usize currencies = benchState.range(1);
+    std::mt19937_64 random(42);
+    for (auto _ : benchState) {
+        benchState.PauseTiming();
+        auto state = make_state(people, 1, currencies);
+        for (usize c = 0; c < currencies; c++)
+            for (usize i = 0; i < people; i++)
+                advance_state(model::Transaction({person_name(i)}, {1., currency_name(c)},
+                                                 {person_name(random() % people)}), state);
+        benchState.ResumeTiming();
+
+        for (usize c = 0; c + 1 < currencies; c++)
+            advance_state(model::CurrencyTransformation(model::Value(1., model::Currency(currency_name(c))),
+                                                        model::Value(2., model::Currency(currency_name(c + 1)))),
+                          state);
+        settle(state);
+        benchmark::DoNotOptimize(state.currencies);
+    }
+}
+
+BENCHMARK(BM_CurrencyTransformation)->Args({1000, 10})->Args({10000, 10})->Args({1000, 1000});
@@ -0,0 +1,299 @@
+#pragma once
+
+#include <benchmark/benchmark.h>
+#include "iterator.h"
+#include <algorithm>
+#include <iomanip>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+/**
+ * Cost of the iterator library compared with hand-written loops. Every chain has a pair of benchmarks
+ * `BM_Penalty_<chain>_Iter` and `BM_Penalty_<chain>_Raw` doing the same work, `PenaltyReporter` compares them.
+ */
+namespace {
+    constexpr usize PENALTY_ELEMENTS = 1 << 20;
+
+    template<typename T>
+    std::vector<T> const &random_input(u64 seed) {
+        static std::map<u64, std::vector<T>> inputs;
+        auto &input = inputs[seed];
+        if (input.empty()) {
+            std::mt19937_64 random(seed);
+            for (usize i = 0; i < PENALTY_ELEMENTS; i++)
+                input.push_back((T) (random() % 1000000));
+        }
+        return input;
+    }
+
+    /**
+     * Measure the function and report the time per element of the input.
+     */
+    template<typename Func>
+    void penalty(benchmark::State &state, Func &&f) {
+        for (auto _ : state)
+            benchmark::DoNotOptimize(f());
+        state.counters["time_per_element"] = benchmark::Counter(PENALTY_ELEMENTS,
+                                                                benchmark::Counter::kIsIterationInvariantRate |
+                                                                benchmark::Counter::kInvert);
+    }
+}
+
+static void BM_Penalty_Map_Iter(benchmark::State &state) {
+    auto const &v = random_input<u64>(1);
+    penalty(state, [&v] { return Iter::from(v).map([](u64 x) { return x * 3 + 1; }).sum(); });
+}
+
+static void BM_Penalty_Map_Raw(benchmark::State &state) {
+    auto const &v = random_input<u64>(1);
+    penalty(state, [&v] {
+        u64 sum = 0;
+        for (u64 x : v)
+            sum += x * 3 + 1;
+        return sum;
+    });
+}
+
+static void BM_Penalty_Filter_Iter(benchmark::State &state) {
+    auto const &v = random_input<u64>(1);
+    penalty(state, [&v] { return Iter::from(v).filter([](u64 x) { return x & 1; }).sum(); });
+}
+
+static void BM_Penalty_Filter_Raw(benchmark::State &state) {
+    auto const &v = random_input<u64>(1);
+    penalty(state, [&v] {
+        u64 sum = 0;
+        for (u64 x : v)
+            if (x & 1)
+                sum += x;
+        return sum;
+    });
+}
+
+static void BM_Penalty_MapFilterFold_Iter(benchmark::State &state) {
+    auto const &v = random_input<u64>(1);
+    penalty(state, [&v] {
+        return Iter::from(v)
+                .map([](u64 x) { return x >> 3; })
+                .filter([](u64 x) { return x % 3 == 0; })
+                .fold([](u64 x, u64 s) { return s + x; }, (u64) 0);
+    });
+}
+
+static void BM_Penalty_MapFilterFold_Raw(benchmark::State &state) {
+    auto const &v = random_input<u64>(1);
+    penalty(state, [&v] {
+        u64 sum = 0;
+        for (u64 x : v)
+            if ((x >> 3) % 3 == 0)
+                sum += x >> 3;
+        return sum;
+    });
+}
+
+/**
+ * Fused chain over doubles, the push protocol should make it the same loop as the hand-written one.
+ */
+static void BM_Penalty_FusedFold_Iter(benchmark::State &state) {
+    auto const &v = random_input<double>(3);
+    penalty(state, [&v] {
+        return Iter::from(v)
+                .map([](double x) { return x * x; })
+                .filter([](double x) { return x < 1e11; })
+                .fold([](double x, double s) { return x + s; }, 0.);
+    });
+}
+
+static void BM_Penalty_FusedFold_Raw(benchmark::State &state) {
+    auto const &v = random_input<double>(3);
+    penalty(state, [&v] {
+        double sum = 0.;
+        for (double x : v)
+            if (x * x < 1e11)
+                sum = x * x + sum;
+        return sum;
+    });
+}
+
+static void BM_Penalty_Zip_Iter(benchmark::State &state) {
+    auto const &a = random_input<u64>(1);
+    auto const &b = random_input<u64>(2);
+    penalty(state, [&a, &b] {
+        return Iter::zip(Iter::from(a), Iter::from(b))
+                .map([](std::pair<u64, u64> p) { return p.first * p.second; })
+                .sum();
+    });
+}
+
+static void BM_Penalty_Zip_Raw(benchmark::State &state) {
+    auto const &a = random_input<u64>(1);
+    auto const &b = random_input<u64>(2);
+    penalty(state, [&a, &b] {
+        u64 sum = 0;
+        for (usize i = 0; i < std::min(a.size(), b.size()); i++)
+            sum += a[i] * b[i];
+        return sum;
+    });
+}
+
+static void BM_Penalty_Enumerate_Iter(benchmark::State &state) {
+    auto const &v = random_input<u64>(1);
+    penalty(state, [&v] {
+        return Iter::from(v).enumerate().map([](std::pair<usize, u64> p) { return p.first ^ p.second; }).sum();
+    });
+}
+
+static void BM_Penalty_Enumerate_Raw(benchmark::State &state) {
+    auto const &v = random_input<u64>(1);
+    penalty(state, [&v] {
+        u64 sum = 0;
+        for (usize i = 0; i < v.size(); i++)
+            sum += i ^ v[i];
+        return sum;
+    });
+}
+
+static void BM_Penalty_Reduce_Iter(benchmark::State &state) {
+    auto const &v = random_input<u64>(1);
+    penalty(state, [&v] { return *Iter::from(v).reduce([](u64 a, u64 b) { return std::max(a, b); }); });
+}
+
+static void BM_Penalty_Reduce_Raw(benchmark::State &state) {
+    auto const &v = random_input<u64>(1);
+    penalty(state, [&v] {
+        u64 best = v[0];
+        for (usize i = 1; i < v.size(); i++)
+            best = std::max(best, v[i]);
+        return best;
+    });
+}
+
+/**
+ * Largest balance with its index, the way the simplifier used to look for the largest loaner.
+ */
+static void BM_Penalty_EnumerateMaxBy_Iter(benchmark::State &state) {
+    auto const &v = random_input<double>(3);
+    penalty(state, [&v] {
+        return Iter::from(v).enumerate().max_by([](std::pair<usize, double> const &p) { return p.second; })->first;
+    });
+}
+
+static void BM_Penalty_EnumerateMaxBy_Raw(benchmark::State &state) {
+    auto const &v = random_input<double>(3);
+    penalty(state, [&v] {
+        usize best = 0;
+        for (usize i = 1; i < v.size(); i++)
+            if (v[i] > v[best])
+                best = i;
+        return best;
+    });
+}
+
+/**
+ * Element-wise sum of two vectors into a new one, the way the balancer used to add debt vectors.
+ */
+static void BM_Penalty_ZipMapCollect_Iter(benchmark::State &state) {
+    auto const &a = random_input<double>(3);
+    auto const &b = random_input<double>(4);
+    penalty(state, [&a, &b] {
+        return Iter::zip(Iter::from(a), Iter::from(b))
+                .map([](std::pair<double, double> p) { return p.first + p.second; })
+                .collect();
+    });
+}
+
+static void BM_Penalty_ZipMapCollect_Raw(benchmark::State &state) {
+    auto const &a = random_input<double>(3);
+    auto const &b = random_input<double>(4);
+    penalty(state, [&a, &b] {
+        std::vector<double> result;
+        result.reserve(std::min(a.size(), b.size()));
+        for (usize i = 0; i < std::min(a.size(), b.size()); i++)
+            result.push_back(a[i] + b[i]);
+        return result;
+    });
+}
+
+BENCHMARK(BM_Penalty_Map_Iter);
+BENCHMARK(BM_Penalty_Map_Raw);
+BENCHMARK(BM_Penalty_Filter_Iter);
+BENCHMARK(BM_Penalty_Filter_Raw);
+BENCHMARK(BM_Penalty_MapFilterFold_Iter);
+BENCHMARK(BM_Penalty_MapFilterFold_Raw);
+BENCHMARK(BM_Penalty_FusedFold_Iter);
+BENCHMARK(BM_Penalty_FusedFold_Raw);
+BENCHMARK(BM_Penalty_Zip_Iter);
+BENCHMARK(BM_Penalty_Zip_Raw);
+BENCHMARK(BM_Penalty_Enumerate_Iter);
+BENCHMARK(BM_Penalty_Enumerate_Raw);
+BENCHMARK(BM_Penalty_Reduce_Iter);
+BENCHMARK(BM_Penalty_Reduce_Raw);
+BENCHMARK(BM_Penalty_EnumerateMaxBy_Iter);
+BENCHMARK(BM_Penalty_EnumerateMaxBy_Raw);
+BENCHMARK(BM_Penalty_ZipMapCollect_Iter);
+BENCHMARK(BM_Penalty_ZipMapCollect_Raw);
+
+/**
+ * Console output with a summary of the abstraction penalty at the end. Chains whose iterator version is more than
+ * the given factor slower than the raw loop are flagged.
+ */
+class PenaltyReporter : public benchmark::ConsoleReporter {
+private:
+    constexpr static const char *PREFIX = "BM_Penalty_";
+
+    double factor;
+    // chain -> (ns per element with iterators, ns per element with a raw loop)
+    std::map<std::string, std::pair<double, double>> chains;
+    usize slow = 0;
+
+public:
+    explicit PenaltyReporter(double factor) : factor{factor} {}
+
+    void ReportRuns(const std::vector<Run> &reports) override {
+        ConsoleReporter::ReportRuns(reports);
+        for (auto const &run : reports) {
+            std::string name = run.benchmark_name();
+            auto counter = run.counters.find("time_per_element");
+            if (run.error_occurred || run.run_type != Run::RT_Iteration || name.rfind(PREFIX, 0) != 0 ||
+                counter == run.counters.end())
+                continue;
+
+            auto separator = name.rfind('_');
+            std::string chain = name.substr(std::string(PREFIX).size(), separator - std::string(PREFIX).size());
+            auto &times = chains[chain];
+            (name.substr(separator + 1) == "Iter" ? times.first : times.second) = counter->second.value * 1e9;
+        }
+    }
+
+    void Finalize() override {
+        ConsoleReporter::Finalize();
+        if (chains.empty())
+            return;
+
+        auto &out = GetOutputStream();
+        out << "\nAbstraction penalty (ns per element, flagged when iterators are more than " << factor
+            << "x slower)\n";
+        out << std::left << std::setw(20) << "chain" << std::right << std::setw(12) << "iterators" << std::setw(12)
+            << "raw loop" << std::setw(10) << "ratio" << "\n";
+        for (auto const &[chain, times] : chains) {
+            if (times.first == 0. || times.second == 0.)
+                continue;
+            double ratio = times.first / times.second;
+            bool flagged = ratio > factor;
+            slow += flagged;
+            out << std::left << std::setw(20) << chain << std::right << std::fixed << std::setprecision(3)
+                << std::setw(12) << times.first << std::setw(12) << times.second << std::setw(9) << ratio << "x"
+                << (flagged ? "  SLOW" : "") << "\n";
+        }
+        out << std::defaultfloat << std::flush;
+    }
+
+    /**
+     * @return number of chains over the factor
+     */
+    usize slow_chains() const {
+        return slow;
+    }
+};
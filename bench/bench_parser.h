@@ -0,0 +1,38 @@
+#pragma once
+
+#include <benchmark/benchmark.h>
+#include "parser.h"
+#include <string>
+#include <vector>
+
+static void BM_TokenSplitter(benchmark::State &state) {
+    std::string line;
+    for (int64_t i = 0; i < state.range(0); i++)
+        line += "person" + std::to_string(i) + "  \t";
+    line += "paid 123.45czk for everybody";
+
+    for (auto _ : state)
+        benchmark::DoNotOptimize(token_splitter(line));
+    state.SetBytesProcessed(state.iterations() * line.size());
+}
+
+BENCHMARK(BM_TokenSplitter)->Arg(1)->Arg(8)->Arg(64);
+
+static void BM_ParseValue(benchmark::State &state) {
+    for (auto _ : state)
+        benchmark::DoNotOptimize(parse_value(std::string("1234.5678czk")));
+}
+
+BENCHMARK(BM_ParseValue);
+
+static void BM_LineParser(benchmark::State &state, const char *line) {
+    auto tokens = token_splitter(line);
+    for (auto _ : state)
+        benchmark::DoNotOptimize(line_parser(tokens));
+}
+
+BENCHMARK_CAPTURE(BM_LineParser, person, "def person John j jb");
+BENCHMARK_CAPTURE(BM_LineParser, group, "def group all John George Mary Anne");
+BENCHMARK_CAPTURE(BM_LineParser, currency, "def currency usd");
+BENCHMARK_CAPTURE(BM_LineParser, transaction, "John George paid 123.45usd for all");
+BENCHMARK_CAPTURE(BM_LineParser, conversion, "convert 1eur to 26czk");
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <benchmark/benchmark.h>
+#include "simplifier.h"
+#include <random>
+#include <vector>
+
+/**
+ * Simplify random balances of the given number of people.
+ */
+static void BM_SimplifiedTransactionGenerator(benchmark::State &benchState) {
+    const usize people = benchState.range(0);
+    std::mt19937_64 random(42);
+    std::vector<person_id_t> ids;
+    std::vector<double> balances;
+    double total = 0.;
+    for (usize i = 0; i < people; i++) {
+        ids.push_back(i);
+        balances.push_back((double) (random() % 100000) / 100 - 500);
+        total += balances.back();
+    }
+    balances.back() -= total;
+
+    for (auto _ : benchState) {
+        benchState.PauseTiming();
+        auto idsCopy = ids;
+        auto balancesCopy = balances;
+        benchState.ResumeTiming();
+
+        usize transactions = 0;
+        SimplifiedTransactionGenerator::create(std::move(idsCopy), std::move(balancesCopy))
+                .into([&transactions](SimpleTransaction) { transactions++; });
+        benchmark::DoNotOptimize(transactions);
+    }
+    benchState.SetItemsProcessed(benchState.iterations() * people);
+}
+
+BENCHMARK(BM_SimplifiedTransactionGenerator)->Arg(10)->Arg(1000)->Arg(10000);
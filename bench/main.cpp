@@ -0,0 +1,42 @@
+#include <benchmark/benchmark.h>
+#include "bench_parser.h"
+#include "bench_balancer.h"
+#include "bench_simplifier.h"
+#include "bench_iterator.h"
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+    // iterator chains slower than this many times the raw loop are flagged
+    constexpr double DEFAULT_PENALTY_FACTOR = 2.;
+    constexpr const char *PENALTY_FLAG = "--penalty_factor=";
+    constexpr const char *FAIL_FLAG = "--fail_on_penalty";
+}
+
+/**
+ * Same as `BENCHMARK_MAIN()`, but with a summary of the abstraction penalty of iterators. The factor is set by
+ * `--penalty_factor=<x>`. With `--fail_on_penalty`, the program exits with 1 when a chain is flagged. All the other
+ * arguments belong to Google Benchmark.
+ */
+int main(int argc, char **argv) {
+    double factor = DEFAULT_PENALTY_FACTOR;
+    bool failOnPenalty = false;
+    int kept = 1;
+    for (int i = 1; i < argc; i++) {
+        if (std::strncmp(argv[i], PENALTY_FLAG, std::strlen(PENALTY_FLAG)) == 0)
+            factor = std::atof(argv[i] + std::strlen(PENALTY_FLAG));
+        else if (std::strcmp(argv[i], FAIL_FLAG) == 0)
+            failOnPenalty = true;
+        else
+            argv[kept++] = argv[i];
+    }
+    argc = kept;
+
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv))
+        return 1;
+    PenaltyReporter reporter(factor);
+    benchmark::RunSpecifiedBenchmarks(&reporter);
+    benchmark::Shutdown();
+    return failOnPenalty && reporter.slow_chains() > 0 ? 1 : 0;
+}
@@ -0,0 +1,299 @@
+/**
+ * Checks how the stages of the program scale with the size of the input.
+ *
+ *      financnidlo-scaling [--full] [stage...]
+ *
+ * Every stage is run over a geometric sweep of one size parameter, the growth exponent is fitted by least squares
+ * on the log-log scale. When it's above the declared bound of the stage (with some tolerance for noise), the program
+ * fails. The default sweep takes about twenty seconds, `--full` goes up to a million people and 10^8 lines.
+ */
+
+#include "balancer.h"
+#include "parser.h"
+#include "simplifier.h"
+#include "types.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    // the fitted exponent may be this much above the bound before it's considered a regression
+    constexpr double TOLERANCE = 0.25;
+    // sizes of a sweep grow by sqrt(10), so there are two points per decade
+    constexpr double SIZE_STEP = 3.1622776601683795;
+    // every size is measured repeatedly, until the measured time or the time including the setup is long enough
+    constexpr double MIN_MEASURED_SECONDS = 0.05;
+    constexpr double MAX_SECONDS_PER_SIZE = 0.5;
+    // lines are created in chunks, the creation is not measured
+    constexpr usize CHUNK = 4096;
+    // people in the stages sweeping the number of lines
+    constexpr usize PEOPLE = 1000;
+    // people defined after the currencies, enough for the time to be well above the noise
+    constexpr usize PEOPLE_AFTER_CURRENCIES = 20000;
+
+    volatile usize sink;
+
+    double seconds_since(Clock::time_point start) {
+        return std::chrono::duration<double>(Clock::now() - start).count();
+    }
+
+    std::string person_name(usize i) {
+        return "person" + std::to_string(i);
+    }
+
+    std::string transaction_line(usize i, usize people) {
+        return person_name(i % people) + " paid " + std::to_string(i % 997 + 1) + "czk for "
+               + person_name((i * 7919 + 13) % people);
+    }
+
+    BalancingState with_people(usize people) {
+        BalancingState state;
+        advance_state(model::Currency("czk"), state);
+        for (usize i = 0; i < people; i++)
+            advance_state(model::Person(person_name(i), {}), state);
+        return state;
+    }
+
+    /**
+     * Tokenize and parse transaction lines.
+     */
+    double parse(usize lines) {
+        std::vector<std::string> chunk;
+        double elapsed = 0.;
+        usize parsed = 0;
+        for (usize done = 0; done < lines;) {
+            chunk.clear();
+            for (; chunk.size() < CHUNK && done < lines; done++)
+                chunk.push_back(transaction_line(done, PEOPLE));
+
+            auto start = Clock::now();
+            for (auto const &line : chunk)
+                parsed += line_parser(token_splitter(line)).index();
+            elapsed += seconds_since(start);
+        }
+        sink = parsed;
+        return elapsed;
+    }
+
+    /**
+     * Apply parsed transactions between a fixed number of people, including the settlement at the end.
+     */
+    double transactions(usize lines) {
+        BalancingState state = with_people(PEOPLE);
+        std::vector<model::ConfigElement> chunk;
+        double elapsed = 0.;
+        for (usize done = 0; done < lines;) {
+            chunk.clear();
+            for (; chunk.size() < CHUNK && done < lines; done++)
+                chunk.push_back(line_parser(token_splitter(transaction_line(done, PEOPLE))));
+
+            auto start = Clock::now();
+            for (auto &element : chunk)
+                advance_state(std::move(element), state);
+            elapsed += seconds_since(start);
+        }
+        auto start = Clock::now();
+        settle(state);
+        return elapsed + seconds_since(start);
+    }
+
+    /**
+     * Define people with aliases.
+     */
+    double people(usize people) {
+        BalancingState state;
+        advance_state(model::Currency("czk"), state);
+        auto start = Clock::now();
+        for (usize i = 0; i < people; i++)
+            advance_state(model::Person(person_name(i), {"alias" + std::to_string(i)}), state);
+        return seconds_since(start);
+    }
+
+    /**
+     * Define a fixed number of people after the given number of currencies, the time should not depend on it.
+     */
+    double people_after_currencies(usize currencies) {
+        BalancingState state;
+        for (usize i = 0; i < currencies; i++)
+            advance_state(model::Currency("currency" + std::to_string(i)), state);
+        auto start = Clock::now();
+        for (usize i = 0; i < PEOPLE_AFTER_CURRENCIES; i++)
+            advance_state(model::Person(person_name(i), {}), state);
+        return seconds_since(start);
+    }
+
+    /**
+     * As many transactions as there are members of a group, each paid for the whole group.
+     */
+    double group_transactions(usize groupSize) {
+        BalancingState state = with_people(groupSize);
+        std::vector<std::string> members;
+        for (usize i = 0; i < groupSize; i++)
+            members.push_back(person_name(i));
+        advance_state(model::Group("everybody", std::move(members)), state);
+
+        auto start = Clock::now();
+        for (usize i = 0; i < groupSize; i++)
+            advance_state(model::Transaction({person_name(i)}, {1. + i % 97, "czk"}, {"everybody"}), state);
+        settle(state);
+        return seconds_since(start);
+    }
+
+    /**
+     * Settle after four transactions per person. All their changes are still buffered, so the settlement applies them.
+     */
+    double settlement(usize people) {
+        BalancingState state = with_people(people);
+        // the default capacity would apply most of the changes during ingest at the upper end of the sweep
+        state.pending = TransactionBatch<DebtVector>(std::numeric_limits<usize>::max());
+        for (usize i = 0; i < 4 * people; i++)
+            advance_state(line_parser(token_splitter(transaction_line(i, people))), state);
+        auto start = Clock::now();
+        settle(state);
+        return seconds_since(start);
+    }
+
+    /**
+     * Simplify random balances of the given number of people.
+     */
+    double simplification(usize people) {
+        std::mt19937_64 random(42);
+        std::vector<person_id_t> ids;
+        std::vector<double> balances;
+        double total = 0.;
+        for (usize i = 0; i < people; i++) {
+            ids.push_back(i);
+            balances.push_back((double) (random() % 100000) / 100 - 500);
+            total += balances.back();
+        }
+        balances.back() -= total;
+
+        auto start = Clock::now();
+        usize count = 0;
+        SimplifiedTransactionGenerator::create(std::move(ids), std::move(balances))
+                .into([&count](SimpleTransaction) { count++; });
+        sink = count;
+        return seconds_since(start);
+    }
+
+    struct Stage {
+        const char *name;
+        const char *parameter;
+        // declared growth exponent of the time in the parameter
+        double bound;
+        usize from;
+        usize to;
+        // upper end of the sweep with `--full`
+        usize fullTo;
+        std::function<double(usize)> measure;
+    };
+
+    const std::vector<Stage> STAGES = {
+            {"parse",                   "lines",      1., 1000, 1000000, 100000000, parse},
+            {"transactions",            "lines",      1., 1000, 1000000, 100000000, transactions},
+            {"people",                  "people",     1., 100,  100000,  1000000,   people},
+            {"people-after-currencies", "currencies", 0., 10,   10000,   100000,    people_after_currencies},
+            {"group-transactions",      "group size", 1., 10,   100000,  1000000,   group_transactions},
+            {"settle",                  "people",     1., 100,  100000,  1000000,   settlement},
+            // greedy simplification scans all balances for every transaction it emits
+            {"simplify",                "people",     2., 100,  10000,   100000,    simplification},
+    };
+
+    /**
+     * @return the best time of repeated runs
+     */
+    double measure(Stage const &stage, usize size) {
+        auto start = Clock::now();
+        double best = INFINITY;
+        double measured = 0.;
+        for (usize runs = 0; runs < 3 || measured < MIN_MEASURED_SECONDS; runs++) {
+            if (runs > 0 && seconds_since(start) > MAX_SECONDS_PER_SIZE)
+                break;
+            double elapsed = stage.measure(size);
+            best = std::min(best, elapsed);
+            measured += elapsed;
+        }
+        return best;
+    }
+
+    /**
+     * Least squares slope of `log(time)` over `log(size)`.
+     */
+    double growth_exponent(std::vector<std::pair<usize, double>> const &points) {
+        double sx = 0., sy = 0., sxx = 0., sxy = 0.;
+        for (auto[size, time] : points) {
+            double x = std::log((double) size);
+            double y = std::log(time);
+            sx += x;
+            sy += y;
+            sxx += x * x;
+            sxy += x * y;
+        }
+        double n = points.size();
+        return (n * sxy - sx * sy) / (n * sxx - sx * sx);
+    }
+
+    /**
+     * @return whether the stage scales within its bound
+     */
+    bool run(Stage const &stage, bool full) {
+        std::cout << stage.name << " (by " << stage.parameter << ", bound n^" << stage.bound << ")" << std::endl;
+        std::vector<std::pair<usize, double>> points;
+        usize to = full ? stage.fullTo : stage.to;
+        for (double size = stage.from; size <= to * 1.0001; size *= SIZE_STEP) {
+            auto n = (usize) std::llround(size);
+            double time = measure(stage, n);
+            points.emplace_back(n, time);
+            std::cout << "  " << std::setw(10) << n << "  " << std::setw(12) << time * 1e3 << " ms  "
+                      << std::setw(10) << time / n * 1e9 << " ns/item" << std::endl;
+        }
+
+        double exponent = growth_exponent(points);
+        bool ok = exponent <= stage.bound + TOLERANCE;
+        std::cout << "  exponent " << exponent << (ok ? "  OK" : "  FAIL") << std::endl;
+        return ok;
+    }
+}
+
+int main(int argc, char **argv) {
+    bool full = false;
+    std::vector<std::string> selected;
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--full") == 0)
+            full = true;
+        else
+            selected.emplace_back(argv[i]);
+    }
+    for (auto const &name : selected) {
+        if (std::none_of(STAGES.begin(), STAGES.end(), [&name](Stage const &s) { return name == s.name; })) {
+            std::cerr << "Usage: " << argv[0] << " [--full] [stage...]" << std::endl;
+            std::cerr << "Stages:";
+            for (auto const &stage : STAGES)
+                std::cerr << ' ' << stage.name;
+            std::cerr << std::endl;
+            return 2;
+        }
+    }
+
+    usize failed = 0;
+    for (auto const &stage : STAGES) {
+        if (selected.empty() || std::find(selected.begin(), selected.end(), stage.name) != selected.end())
+            failed += !run(stage, full);
+    }
+
+    if (failed > 0) {
+        std::cout << failed << " stage(s) scale worse than declared" << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,200 @@
+#pragma once
+
+#include "types.h"
+#include <array>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <ostream>
+#include <utility>
+
+/**
+ * Accounting of heap allocations per subsystem, compiled in only with `FINANCNIDLO_TRACK_ALLOCATIONS`.
+ *
+ * The global `operator new` and `operator delete` are replaced, every allocation is attributed to the scope active
+ * on its thread. Scopes are set by `ALLOC_SCOPE(name)` for the rest of the enclosing block and they nest, the innermost
+ * wins. Freed memory is subtracted from the scope which allocated it, so the live and peak bytes of a scope are exact.
+ *
+ * The replaced allocator is defined in this header, so with tracking enabled it must be included by exactly one
+ * translation unit. That's true for all the executables of this project. Without tracking, `ALLOC_SCOPE` expands
+ * to nothing and the counters are never touched.
+ */
+namespace alloc {
+
+#ifdef FINANCNIDLO_TRACK_ALLOCATIONS
+    constexpr bool ENABLED = true;
+#else
+    constexpr bool ENABLED = false;
+#endif
+
+    enum class Scope : unsigned char {
+        other, parser, registry, balancer, simplifier, output
+    };
+
+    constexpr usize NUMBER_OF_SCOPES = 6;
+    constexpr const char *SCOPE_NAMES[NUMBER_OF_SCOPES] = {
+            "other", "parser", "registry", "balancer", "simplifier", "output"
+    };
+
+    struct Counters {
+        std::atomic<u64> allocations{0};
+        std::atomic<u64> bytes{0};
+        std::atomic<i64> live{0};
+        std::atomic<i64> peak{0};
+    };
+
+    struct Totals {
+        std::array<Counters, NUMBER_OF_SCOPES> scopes;
+        // live and peak bytes of all scopes together
+        Counters all;
+        std::atomic<u64> lines{0};
+    };
+
+    /**
+     * Constructed on the first allocation, it contains only atomics, so it does not allocate itself.
+     */
+    inline Totals &totals() {
+        static Totals t;
+        return t;
+    }
+
+    inline thread_local Scope current = Scope::other;
+
+    namespace detail {
+        inline void raise(std::atomic<i64> &peak, i64 value) {
+            i64 seen = peak.load(std::memory_order_relaxed);
+            while (value > seen && !peak.compare_exchange_weak(seen, value, std::memory_order_relaxed)) {}
+        }
+
+        inline void allocated(Counters &c, usize size) {
+            c.allocations.fetch_add(1, std::memory_order_relaxed);
+            c.bytes.fetch_add(size, std::memory_order_relaxed);
+            raise(c.peak, c.live.fetch_add(size, std::memory_order_relaxed) + (i64) size);
+        }
+
+        /**
+         * Every block starts with this header, so that it's known how much and to whom it's returned on free.
+         * It's as large as the alignment of `malloc`, so the memory after it stays aligned the same.
+         */
+        struct alignas(alignof(std::max_align_t)) BlockHeader {
+            usize size;
+            Scope scope;
+        };
+    }
+
+    /**
+     * Sets the scope of allocations on this thread until it's destroyed. Use through `ALLOC_SCOPE`.
+     */
+    class ScopeGuard {
+    private:
+        Scope previous;
+    public:
+        explicit ScopeGuard(Scope scope) : previous{current} {
+            current = scope;
+        }
+
+        ScopeGuard(ScopeGuard &other) = delete;
+
+        ~ScopeGuard() {
+            current = previous;
+        }
+    };
+
+    /**
+     * Wrap the function, so that it allocates in the given scope. Without tracking the function is returned as it is.
+     */
+    template<Scope scope, typename Func>
+    auto tracked(Func f) {
+        if constexpr (!ENABLED) {
+            return f;
+        } else {
+            return [f](auto &&... args) -> decltype(auto) {
+                ScopeGuard guard(scope);
+                return f(std::forward<decltype(args)>(args)...);
+            };
+        }
+    }
+
+    inline void count_line() {
+        if constexpr (ENABLED)
+            totals().lines.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /**
+     * @return number of allocations in all scopes since the start of the program
+     */
+    inline u64 allocation_count() {
+        u64 sum = 0;
+        for (auto const &c : totals().scopes)
+            sum += c.allocations.load(std::memory_order_relaxed);
+        return sum;
+    }
+
+    inline Counters const &of(Scope scope) {
+        return totals().scopes[(usize) scope];
+    }
+
+    /**
+     * Forget the peaks, so that the next ones are measured from the currently live memory.
+     */
+    inline void reset_peaks() {
+        for (auto &c : totals().scopes)
+            c.peak = c.live.load();
+        totals().all.peak = totals().all.live.load();
+    }
+
+    /**
+     * One JSON line with allocations, bytes and peak live bytes of every scope. Averages per line are computed from
+     * the lines counted by `count_line`.
+     */
+    inline void write_report(std::ostream &out) {
+        auto const &t = totals();
+        u64 lines = t.lines;
+        auto const perLine = [lines](u64 amount) { return lines > 0 ? (double) amount / lines : 0.; };
+
+        out << "{\"lines\":" << lines << ",\"peak_bytes\":" << t.all.peak << ",\"scopes\":{";
+        for (usize i = 0; i < NUMBER_OF_SCOPES; i++) {
+            auto const &c = t.scopes[i];
+            out << (i == 0 ? "" : ",") << "\"" << SCOPE_NAMES[i] << "\":{\"allocations\":" << c.allocations
+                << ",\"bytes\":" << c.bytes << ",\"peak_bytes\":" << c.peak
+                << ",\"allocations_per_line\":" << perLine(c.allocations)
+                << ",\"bytes_per_line\":" << perLine(c.bytes) << "}";
+        }
+        out << "}}" << std::endl;
+    }
+}
+
+#ifdef FINANCNIDLO_TRACK_ALLOCATIONS
+
+#define ALLOC_SCOPE(scope) alloc::ScopeGuard allocScopeGuard(alloc::Scope::scope)
+
+void *operator new(std::size_t size) {
+    using alloc::detail::BlockHeader;
+    void *block = std::malloc(sizeof(BlockHeader) + size);
+    if (block == nullptr)
+        throw std::bad_alloc();
+    auto *header = new(block) BlockHeader{size, alloc::current};
+    alloc::detail::allocated(alloc::totals().scopes[(usize) header->scope], size);
+    alloc::detail::allocated(alloc::totals().all, size);
+    return header + 1;
+}
+
+void operator delete(void *p) noexcept {
+    using alloc::detail::BlockHeader;
+    if (p == nullptr)
+        return;
+    auto *header = static_cast<BlockHeader *>(p) - 1;
+    alloc::totals().scopes[(usize) header->scope].live.fetch_sub(header->size, std::memory_order_relaxed);
+    alloc::totals().all.live.fetch_sub(header->size, std::memory_order_relaxed);
+    std::free(header);
+}
+
+void operator delete(void *p, std::size_t) noexcept {
+    operator delete(p);
+}
+
+#else
+
+#define ALLOC_SCOPE(scope) ((void) 0)
+
+#endif
@@ -2,19 +2,26 @@
 
 #include "types.h"
 #include "model.h"
+#include "alloc_tracker.h"
+#include "trace.h"
 #include <unordered_map>
 #include <variant>
 #include <vector>
-#include <unordered_set>
 #include <ostream>
 #include "iterator.h"
 #include "people.h"
+#include "conversions.h"
+#include "batch.h"
+#include "groups.h"
+#include "debts.h"
+#include <array>
 
 
 namespace {
-    using DebtVector = std::vector<double>;
     using CurrencyDebts = std::unordered_map<std::string, DebtVector>;
-    using Conversions = std::unordered_map<std::string, model::Value>;
+
+    // handling of a single config element is traced only when it takes at least this long, in nanoseconds
+    constexpr i64 TRACE_HANDLE_THRESHOLD = 50000;
 }
 
 class BalancingState {
@@ -22,126 +29,177 @@ private:
 public:
     CurrencyDebts currencies;
     IDRegister people;
-    Conversions conversions;
+    ConversionGraph conversions;
+    TransactionBatch<DebtVector> pending;
+    GroupAccumulator<DebtVector> groupShares;
+    PeopleScratch scratch;
 
-    BalancingState() : currencies{}, people{}, conversions{} {}
+    BalancingState() : currencies{}, people{}, conversions{}, pending{}, groupShares{}, scratch{} {}
 
     BalancingState(BalancingState &other) = delete;
 
-    BalancingState(BalancingState &&old) /*:currencies(std::move(old.currencies)), people(std::move(old.people))*/ {
-        // TODO wtf
-        // WTF!!! This fails when I get rid of the swaps and put the initialization up into the constructor definition,
-        // It causes state passing in iterators to stop working
-        std::swap(currencies, old.currencies);
-        std::swap(people, old.people);
-        std::swap(conversions, old.conversions);
-
-    }
+    BalancingState(BalancingState &&old) = default;
 
-    BalancingState &operator=(BalancingState &&old) {
-        std::swap(currencies, old.currencies);
-        std::swap(people, old.people);
-        std::swap(conversions, old.conversions);
-        return *this;
-    }
+    BalancingState &operator=(BalancingState &&old) = default;
 };
 
 void handle_def_person(BalancingState &state, model::Person p) {
+    trace::Span span("handle_def_person", TRACE_HANDLE_THRESHOLD);
+    state.pending.flush();
+    ALLOC_SCOPE(registry);
     state.people.add_person(std::move(p));
-
-    // add the person to each currency debt vector
-    for (auto&[curr, debtVector] : state.currencies) {
-        debtVector.push_back(0.0);
-    }
 }
 
 void handle_def_group(BalancingState &state, model::Group g) {
+    trace::Span span("handle_def_group", TRACE_HANDLE_THRESHOLD);
+    state.pending.flush();
+    ALLOC_SCOPE(registry);
     state.people.add_group(std::move(g));
 }
 
 void handle_def_currency(BalancingState &state, model::Currency c) {
-    auto n = state.people.get_number_of_people();
-    auto p = DebtVector(n);
-    auto[col, success] = state.currencies.insert({c.name, std::move(p)});
+    trace::Span span("handle_def_currency", TRACE_HANDLE_THRESHOLD);
+    state.pending.flush();
+    auto[col, success] = state.currencies.insert({c.name, DebtVector()});
     if (!success) {
         std::cerr << "Currency \"" << c.name << "\" is defined twice!" << std::endl;
         throw "Currency definition occured for the second time with the same name";
     }
 }
 
-std::unordered_set<person_id_t> get_all_people(BalancingState const &state, std::vector<std::string> const &paidBy) {
-    std::unordered_set<person_id_t> payees;
-    for (auto name : paidBy) {
-        if (state.people.is_person(name)) {
-            payees.insert(state.people.get_id(name));
-        } else if (state.people.is_group(name)) {
-            auto r = state.people.get_group_members(name);
-            payees.insert(r.begin(), r.end());
-        } else {
-            throw std::logic_error("No group or person with name \"" + name + "\" exists...");
+/**
+ * Resolve names of people and groups to a set of unique person ids.
+ * @param buffer storage for the result, used only when the ids can't be returned directly
+ * @return reference to either the buffer or to members of a group, valid until the next call
+ */
+std::vector<person_id_t> const &get_all_people(BalancingState &state, std::vector<std::string> const &names,
+                                               std::vector<person_id_t> &buffer) {
+    buffer.clear();
+
+    if (names.size() == 1) {
+        // single person or group can't contain duplicates
+        auto const &name = names.front();
+        if (auto id = state.people.find_person(name)) {
+            buffer.push_back(*id);
+            return buffer;
+        } else if (auto members = state.people.find_group(name)) {
+            return *members;
+        }
+    } else {
+        state.scratch.next_epoch(state.people.get_number_of_people());
+        for (auto const &name : names) {
+            if (auto id = state.people.find_person(name)) {
+                if (state.scratch.mark(*id))
+                    buffer.push_back(*id);
+            } else if (auto members = state.people.find_group(name)) {
+                for (auto id : *members)
+                    if (state.scratch.mark(id))
+                        buffer.push_back(id);
+            } else {
+                throw std::logic_error("No group or person with name \"" + name + "\" exists...");
+            }
         }
+        return buffer;
     }
-    return payees;
+
+    throw std::logic_error("No group or person with name \"" + names.front() + "\" exists...");
 }
 
-void handle_transaction(BalancingState &state, model::Transaction t) {
-    auto payees = get_all_people(state, t.paidBy);
-    auto receivers = get_all_people(state, t.paidFor);
+/**
+ * Split the amount equally between all the named people and groups. When the name is a single group, the amount
+ * is only added to the group counter and it's distributed to the members later.
+ */
+void split_between(BalancingState &state, DebtVector &debtVector, std::vector<std::string> const &names,
+                   std::vector<person_id_t> &buffer, double amount, double conversionRate) {
+    if (names.size() == 1) {
+        auto const &name = names.front();
+        if (auto id = state.people.find_person(name)) {
+            state.pending.add(debtVector, std::array{*id}, amount * conversionRate);
+            return;
+        } else if (auto group = state.people.find_group_id(name)) {
+            auto members = state.people.get_group_members(*group).size();
+            state.groupShares.add(debtVector, *group, amount / members * conversionRate);
+            return;
+        }
+    }
 
-    auto currency = t.value.second;
-    DebtVector *debtVector = &state.currencies.at(t.value.second);  //FIXME can we do it without using pointers and only
-                                                                    // using references? I don't know how
+    auto const &people = get_all_people(state, names, buffer);
+    state.pending.add(debtVector, people, amount / people.size() * conversionRate);
+}
+
+void handle_transaction(BalancingState &state, model::Transaction t) {
+    trace::Span span("handle_transaction", TRACE_HANDLE_THRESHOLD);
+    DebtVector *debtVector;     //FIXME can we do it without using pointers and only
+                                // using references? I don't know how
     double conversionRate = 1.;
 
-    // check if we should perform conversion
-    auto conversion = state.conversions.find(currency);
-    if (conversion != state.conversions.end()) {
-        debtVector = &state.currencies.at(conversion->second.second.name);
-        conversionRate = conversion->second.first;
+    auto currency = state.currencies.find(t.value.second);
+    if (currency != state.currencies.end()) {
+        // conversions of defined currencies are applied during settlement
+        debtVector = &currency->second;
+    } else {
+        // the currency was never defined, but it might be converted to one which was
+        auto[rate, root] = state.conversions.resolve(t.value.second);
+        debtVector = &state.currencies.at(root);
+        conversionRate = rate;
     }
 
-    auto paidByIndividual = t.value.first / payees.size();
-    auto receivedByIndividual = t.value.first / receivers.size();
-
-    // add debt to each receiver
-    for (auto id : receivers)
-        debtVector->at(id) = debtVector->at(id) + receivedByIndividual * conversionRate;
+    // add debt to each receiver and remove it from each payee, the changes are applied later in bulk
+    split_between(state, *debtVector, t.paidFor, state.scratch.receivers, t.value.first, conversionRate);
+    split_between(state, *debtVector, t.paidBy, state.scratch.payees, -t.value.first, conversionRate);
+    if (state.pending.full())
+        state.pending.flush();
+}
 
-    // remove debt from each payee
-    for (auto id : payees)
-        debtVector->at(id) = debtVector->at(id) - paidByIndividual * conversionRate;
+/**
+ * Finish all the work deferred during ingest. Must be called after the last config element and before the debt
+ * vectors are simplified. More elements can be applied afterwards, the next call finishes only the work deferred
+ * since this one.
+ *
+ * The balances are not bit for bit the same as when every share is added to its person right away. Shares paid for
+ * a whole group are summed per group before they reach the members, so the floating point additions happen in another
+ * order. A balance made of k added amounts differs by at most 2k * 2^-53 times the sum of their absolute values, and
+ * an amount printed with six significant digits can differ in the last digit.
+ */
+void settle(BalancingState &state) {
+    trace::Span span("settle");
+    ALLOC_SCOPE(balancer);
+    state.pending.flush();
+    state.groupShares.expand(state.people);
+    state.conversions.apply(state.currencies);
 }
 
 void handle_currency_transformation(BalancingState &state, model::CurrencyTransformation transformation) {
+    trace::Span span("handle_currency_transformation", TRACE_HANDLE_THRESHOLD);
+    state.pending.flush();
+
     const auto& from = transformation.first;
     const auto& to = transformation.second;
 
-    const auto sourceCurrencyName = from.second.name;
-    if (state.conversions.find(sourceCurrencyName) != state.conversions.end()) {
+    auto sourceCurrencyName = from.second.name;
+    if (state.conversions.is_converted(sourceCurrencyName)) {
         std::cerr << "Duplicate currency conversion found! Aborting!" << std::endl;
-        abort();
+        throw std::logic_error("Currency \"" + sourceCurrencyName + "\" is converted twice");
+    }
+    if (sourceCurrencyName == to.second.name) {
+        std::cerr << "Currency conversion into itself found! Aborting!" << std::endl;
+        throw std::logic_error("Currency \"" + sourceCurrencyName + "\" is converted into itself");
     }
-    const auto targetCurrencyName = to.second.name;
     const double conversionRate = to.first / from.first;
 
-    // save the conversion rate
-    state.conversions.insert({sourceCurrencyName, std::make_pair(conversionRate, targetCurrencyName)});
-
-    // convert all existing balance
-    auto res = state.currencies.find(sourceCurrencyName);
-    if (res != state.currencies.end()) {
-        const auto sourceDebtVector = res->second;
-        const auto targetDebtVector = state.currencies.at(targetCurrencyName);
-        DebtVector nTarget = Iter::zip(Iter::from(sourceDebtVector), Iter::from(targetDebtVector))
-                .map([=](auto vals){ return vals.second + vals.first * conversionRate;})
-                .collect();
-        state.currencies[targetCurrencyName] = nTarget;
-        state.currencies[sourceCurrencyName] = DebtVector(state.people.get_number_of_people());
+    if (state.conversions.closes_cycle(sourceCurrencyName, to.second.name)) {
+        // the balances have to be moved along the chain back to the source before it's converted again
+        settle(state);
+        state.conversions.retire_chain(to.second.name, state.currencies);
     }
+
+    // only record the rate, balances are moved once during settlement
+    state.conversions.add(std::move(sourceCurrencyName), conversionRate, to.second.name);
 }
 
 
-auto constexpr advance_state = [](model::ConfigElement &&config, BalancingState &&state) -> BalancingState {
+auto constexpr advance_state = [](model::ConfigElement &&config, BalancingState &state) {
+    ALLOC_SCOPE(balancer);
     std::visit(overloaded {
             [&state](model::Person &&arg) { handle_def_person(state, std::move(arg)); },
             [&state](model::Group &&arg) { handle_def_group(state, std::move(arg)); },
@@ -153,5 +211,4 @@ auto constexpr advance_state = [](model::ConfigElement &&config, BalancingState
                 abort();
             }
     }, std::move(config));
-    return std::move(state);
 };
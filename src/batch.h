@@ -0,0 +1,163 @@
+#pragma once
+
+#include "types.h"
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <thread>
+
+/**
+ * Buffer for resolved balance changes. Instead of writing every share of every transaction directly to its place in
+ * a (possibly huge) debt vector, the changes are stored in a structure-of-arrays form bucketed by currency. When
+ * flushed, every bucket is partitioned by person id into cache sized blocks using a stable counting sort and then
+ * applied block by block, so the writes are no longer scattered all over the memory.
+ *
+ * Large flushes are applied in parallel. Every worker thread gets its own contiguous range of blocks, so the threads
+ * write to disjoint shards of the debt vector and no merging is needed afterwards.
+ *
+ * The partitioning is stable, so the changes of every single person are applied in the same order as they were
+ * added, no matter how many threads are used. The result of the batch is therefore exactly the same as if they were
+ * applied immediately one by one. That does not hold for the whole balancer, which sums the shares of groups
+ * separately, see `settle`.
+ *
+ * @tparam DebtVector type of the debt vectors the changes are applied to, see `debts.h` for the interface
+ */
+template<typename DebtVector>
+class TransactionBatch {
+private:
+    struct Bucket {
+        std::vector<usize> ids;
+        std::vector<double> deltas;
+    };
+
+    // 4096 doubles - 32kB, about the size of L1 cache
+    constexpr static usize BLOCK_BITS = 12;
+    // below this, starting the threads costs more than the work itself
+    constexpr static usize PARALLEL_THRESHOLD = 1 << 15;
+
+    std::unordered_map<DebtVector *, Bucket> buckets;
+    usize size = 0;
+    usize capacity;
+    usize threads;
+
+    // reused scratch space for the partitioning
+    std::vector<usize> blockOffsets;
+    std::vector<usize> sortedIds;
+    std::vector<double> sortedDeltas;
+
+    void apply(DebtVector &debtVector, Bucket &bucket) {
+        const usize n = bucket.ids.size();
+
+        if (!debtVector.is_dense()) {
+            // sparse vectors are hash maps, there is no locality to gain
+            for (usize i = 0; i < n; i++)
+                debtVector.add(bucket.ids[i], bucket.deltas[i]);
+            return;
+        }
+
+        debtVector.grow(*std::max_element(bucket.ids.begin(), bucket.ids.end()) + 1);
+        double *debts = debtVector.data();
+        const usize blocks = (debtVector.size() >> BLOCK_BITS) + 1;
+
+        if (blocks == 1) {
+            // everything fits into a single block, partitioning would not help
+            for (usize i = 0; i < n; i++)
+                debts[bucket.ids[i]] += bucket.deltas[i];
+            return;
+        }
+
+        // stable counting sort by block
+        blockOffsets.assign(blocks + 1, 0);
+        for (usize i = 0; i < n; i++)
+            blockOffsets[(bucket.ids[i] >> BLOCK_BITS) + 1]++;
+        for (usize b = 1; b <= blocks; b++)
+            blockOffsets[b] += blockOffsets[b - 1];
+
+        sortedIds.resize(n);
+        sortedDeltas.resize(n);
+        for (usize i = 0; i < n; i++) {
+            usize pos = blockOffsets[bucket.ids[i] >> BLOCK_BITS]++;
+            sortedIds[pos] = bucket.ids[i];
+            sortedDeltas[pos] = bucket.deltas[i];
+        }
+
+        // streaming pass over the debt vector, blockOffsets[b] now points to the end of block b
+        if (threads < 2 || n < PARALLEL_THRESHOLD) {
+            apply_sorted(debts, 0, n);
+            return;
+        }
+
+        std::vector<std::thread> workers;
+        const usize shardSize = (n + threads - 1) / threads;
+        usize shardStart = 0;
+        for (usize b = 0; b < blocks; b++) {
+            const usize shardEnd = blockOffsets[b];
+            if (shardEnd > shardStart && (shardEnd - shardStart >= shardSize || b == blocks - 1)) {
+                workers.emplace_back([this, debts, shardStart, shardEnd]() {
+                    apply_sorted(debts, shardStart, shardEnd);
+                });
+                shardStart = shardEnd;
+            }
+        }
+        for (auto &worker : workers)
+            worker.join();
+    }
+
+    void apply_sorted(double *debts, usize from, usize to) const {
+        for (usize i = from; i < to; i++)
+            debts[sortedIds[i]] += sortedDeltas[i];
+    }
+
+public:
+    /**
+     * @param capacity number of buffered changes, which triggers a flush
+     * @param threads maximal number of threads used for applying the changes
+     */
+    explicit TransactionBatch(usize capacity = 1 << 18, usize threads = std::thread::hardware_concurrency())
+            : capacity{capacity}, threads{threads} {}
+
+    TransactionBatch(TransactionBatch &other) = delete;
+
+    TransactionBatch(TransactionBatch &&old) = default;
+
+    TransactionBatch &operator=(TransactionBatch &&old) = default;
+
+    bool empty() const {
+        return size == 0;
+    }
+
+    bool full() const {
+        return size >= capacity;
+    }
+
+    /**
+     * Add the same change to the balance of all the supplied people.
+     * @tparam People iterable collection of person ids
+     */
+    template<typename People>
+    void add(DebtVector &debtVector, People const &people, double delta) {
+        auto &bucket = buckets[&debtVector];
+        for (usize id : people) {
+            bucket.ids.push_back(id);
+            bucket.deltas.push_back(delta);
+        }
+        size += people.size();
+    }
+
+    /**
+     * Apply all buffered changes. The buffers keep their capacity, so that they can be reused.
+     */
+    void flush() {
+        if (empty())
+            return;
+
+        for (auto &[debtVector, bucket] : buckets) {
+            if (bucket.ids.empty())
+                continue;
+            apply(*debtVector, bucket);
+            bucket.ids.clear();
+            bucket.deltas.clear();
+        }
+        size = 0;
+    }
+};
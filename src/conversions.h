@@ -0,0 +1,124 @@
+#pragma once
+
+#include "types.h"
+#include "trace.h"
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <stdexcept>
+
+/**
+ * Stores currency conversions as a graph. Every currency can be converted into at most one other currency, so
+ * the graph is a forest whose roots are the currencies which are not converted any further.
+ *
+ * Recording a conversion does not touch any balances. Those are moved only once, during settlement, using the
+ * composite rates of the whole conversion chains. That is exact, because conversion is linear and it does not matter
+ * when the balance was accumulated.
+ *
+ * A conversion back into a currency of its own chain, e.g. `convert A to B` followed by `convert B to A`, would form
+ * a cycle. The balances of such a chain have to be moved before the new conversion is recorded, see `retire_chain`.
+ */
+class ConversionGraph {
+private:
+    // source currency -> (rate, target currency)
+    std::unordered_map<std::string, std::pair<double, std::string>> edges;
+    // source currency -> (composite rate, root currency), filled lazily by `resolve`
+    mutable std::unordered_map<std::string, std::pair<double, std::string>> resolved;
+    // currencies whose conversions were already applied and removed from the graph
+    std::unordered_set<std::string> retired;
+
+public:
+    ConversionGraph() : edges{}, resolved{}, retired{} {}
+
+    ConversionGraph(ConversionGraph &other) = delete;
+
+    ConversionGraph(ConversionGraph &&old) = default;
+
+    ConversionGraph &operator=(ConversionGraph &&old) = default;
+
+    bool is_converted(const std::string &currency) const {
+        return edges.find(currency) != edges.end() || retired.find(currency) != retired.end();
+    }
+
+    /**
+     * @return whether a conversion from `source` to `target` would form a cycle, a conversion of a currency into itself
+     * is not one and has to be refused before
+     */
+    bool closes_cycle(const std::string &source, const std::string &target) const {
+        return resolve(target).second == source;
+    }
+
+    /**
+     * Record a conversion of all `source` balance into `target`, one unit of source being worth `rate` units of target.
+     * Throws when it would close a cycle, retire the chain of `target` first.
+     */
+    void add(std::string source, double rate, std::string target) {
+        if (resolve(target).second == source)
+            throw std::logic_error("Currency conversion from \"" + source + "\" to \"" + target + "\" forms a cycle");
+
+        edges.insert({std::move(source), std::make_pair(rate, std::move(target))});
+        resolved.clear();
+    }
+
+    /**
+     * Follow the conversion chain starting at the supplied currency.
+     * @return composite rate and the currency at the end of the chain
+     */
+    std::pair<double, std::string> resolve(const std::string &currency) const {
+        auto edge = edges.find(currency);
+        if (edge == edges.end())
+            return std::make_pair(1., currency);
+
+        auto cached = resolved.find(currency);
+        if (cached != resolved.end())
+            return cached->second;
+
+        auto[rate, root] = resolve(edge->second.second);
+        auto result = std::make_pair(rate * edge->second.first, std::move(root));
+        resolved.insert({currency, result});
+        return result;
+    }
+
+    /**
+     * Remove the conversion chain starting at the supplied currency from the graph. Its balances must already be
+     * applied, the currencies of the chain get empty balances of their own and stay converted for `is_converted`.
+     * @tparam CurrencyDebts map from currency name to its debt vector
+     */
+    template<typename CurrencyDebts>
+    void retire_chain(std::string currency, CurrencyDebts &currencies) {
+        for (auto edge = edges.find(currency); edge != edges.end(); edge = edges.find(currency)) {
+            currencies.insert({currency, typename CurrencyDebts::mapped_type()});
+            retired.insert(currency);
+            auto next = std::move(edge->second.second);
+            edges.erase(edge);
+            currency = std::move(next);
+        }
+        resolved.clear();
+    }
+
+    /**
+     * Move balances of all converted currencies into the roots of their conversion chains. Every converted debt vector
+     * is added to its root in one pass and removed afterwards.
+     * @tparam CurrencyDebts map from currency name to its debt vector
+     */
+    template<typename CurrencyDebts>
+    void apply(CurrencyDebts &currencies) const {
+        for (auto const &[source, edge] : edges) {
+            auto debts = currencies.find(source);
+            if (debts == currencies.end())
+                continue;
+
+            trace::Span span("convert");
+            span.set_detail(source);
+            span.set_count(debts->second.size());
+            auto[rate, root] = resolve(source);
+            auto target = currencies.find(root);
+            if (target == currencies.end())
+                throw std::logic_error("Currency \"" + source + "\" is converted to undefined currency \"" + root + "\"");
+
+            target->second.add_scaled(debts->second, rate);
+            currencies.erase(debts);
+        }
+    }
+};
@@ -0,0 +1,135 @@
+#pragma once
+
+#include "types.h"
+#include "people.h"
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+
+/**
+ * Balances of all people in a single currency. Positive balance means that the person is owed money.
+ *
+ * Most currencies are used only by a few people, so every debt vector starts as a sparse map from person id to their
+ * balance. Once the map would take more memory than a plain dense vector, it's converted to the dense vector and it
+ * stays that way. The dense vector is grown lazily to the highest id used, defining new people does not touch it.
+ */
+class DebtVector {
+private:
+    // approximate number of bytes taken by one entry of the sparse map - the node itself and its bucket
+    constexpr static usize SPARSE_ENTRY_COST = 40;
+
+    std::unordered_map<person_id_t, double> sparse;
+    std::vector<double> dense;
+    // highest used id + 1
+    usize span = 0;
+    bool isDense = false;
+
+    void promote() {
+        dense.assign(span, 0.);
+        for (auto[id, amount] : sparse)
+            dense[id] = amount;
+        sparse = {};
+        isDense = true;
+    }
+
+public:
+    DebtVector() : sparse{}, dense{} {}
+
+    DebtVector(DebtVector &other) = delete;
+
+    DebtVector(DebtVector &&old) = default;
+
+    DebtVector &operator=(DebtVector &&old) = default;
+
+    bool is_dense() const {
+        return isDense;
+    }
+
+    /**
+     * @return upper bound of ids with non-zero balance
+     */
+    usize size() const {
+        return isDense ? dense.size() : span;
+    }
+
+    /**
+     * Continuous balances of all people up to `size()`. Valid only for dense vectors until the next `add` or `grow`.
+     */
+    double *data() {
+        return dense.data();
+    }
+
+    /**
+     * Make sure that a dense vector has a place for all ids lower than `n`. Does nothing for sparse vectors.
+     */
+    void grow(usize n) {
+        if (isDense && dense.size() < n)
+            dense.resize(n, 0.);
+    }
+
+    void add(person_id_t id, double delta) {
+        if (isDense) {
+            grow(id + 1);
+            dense[id] += delta;
+            return;
+        }
+
+        sparse[id] += delta;
+        span = std::max(span, id + 1);
+        if (sparse.size() * SPARSE_ENTRY_COST > span * sizeof(double))
+            promote();
+    }
+
+    /**
+     * Add balances from the other vector multiplied by the supplied rate.
+     */
+    void add_scaled(DebtVector const &other, double rate) {
+        if (isDense && other.isDense) {
+            grow(other.dense.size());
+            const usize n = other.dense.size();
+            double *target = dense.data();
+            const double *source = other.dense.data();
+            for (usize i = 0; i < n; i++)
+                target[i] += source[i] * rate;
+        } else {
+            other.for_each_nonzero([this, rate](person_id_t id, double amount) { add(id, amount * rate); });
+        }
+    }
+
+    /**
+     * Run the function for every person with non-zero balance.
+     * @tparam Func function taking `person_id_t` and `double`
+     */
+    template<typename Func>
+    void for_each_nonzero(Func &&f) const {
+        if (isDense) {
+            for (usize id = 0; id < dense.size(); id++)
+                if (dense[id] != 0.)
+                    f(id, dense[id]);
+        } else {
+            for (auto[id, amount] : sparse)
+                if (amount != 0.)
+                    f(id, amount);
+        }
+    }
+
+    /**
+     * @return ids of all people with non-zero balance ordered by the id and their balances
+     */
+    std::pair<std::vector<person_id_t>, std::vector<double>> nonzero() const {
+        std::vector<std::pair<person_id_t, double>> entries;
+        for_each_nonzero([&entries](person_id_t id, double amount) { entries.emplace_back(id, amount); });
+        if (!isDense)
+            std::sort(entries.begin(), entries.end());
+
+        std::vector<person_id_t> ids;
+        std::vector<double> amounts;
+        ids.reserve(entries.size());
+        amounts.reserve(entries.size());
+        for (auto[id, amount] : entries) {
+            ids.push_back(id);
+            amounts.push_back(amount);
+        }
+        return std::make_pair(std::move(ids), std::move(amounts));
+    }
+};
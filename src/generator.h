@@ -0,0 +1,245 @@
+#pragma once
+
+/**
+ * Coroutine based iterators, available only when compiled as C++20 or newer.
+ *
+ * A `generator<T>` is a function which `co_yield`s its values. It satisfies `is_iterator`, so it can be wrapped by `I`
+ * and used as any other source in the library:
+ *
+ *      generator<usize> squares(usize n) {
+ *          for (usize i = 0; i < n; i++)
+ *              co_yield i * i;
+ *      }
+ *
+ *      auto sum = I(squares(10)).sum();
+ *
+ * The coroutine frame is allocated once, when the generator is created. Yielding a value only suspends the function,
+ * the value is moved out directly from the suspended frame.
+ *
+ * `async_generator<T>` can also `co_await read_some(fd, buffer, size)` on a non-blocking file descriptor. When there is
+ * nothing to read, the generator is suspended and `next()` waits with `poll()` until the descriptor becomes readable.
+ */
+
+#if __has_include(<coroutine>) && defined(__cpp_impl_coroutine)
+
+#define FINANCNIDLO_COROUTINES
+
+#include "types.h"
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <utility>
+#include <cerrno>
+#include <string>
+#include <poll.h>
+#include <unistd.h>
+
+template<typename T>
+struct generator_promise_base {
+    T *value = nullptr;
+    std::exception_ptr error;
+
+    std::suspend_always initial_suspend() noexcept { return {}; }
+
+    std::suspend_always final_suspend() noexcept { return {}; }
+
+    std::suspend_always yield_value(T &v) noexcept {
+        value = &v;
+        return {};
+    }
+
+    std::suspend_always yield_value(T &&v) noexcept {
+        value = &v;
+        return {};
+    }
+
+    void return_void() noexcept {}
+
+    void unhandled_exception() noexcept {
+        error = std::current_exception();
+    }
+};
+
+/**
+ * Owns the coroutine frame and resumes it on `next()`. The yielded value is moved out of the frame.
+ * @tparam T type of the yielded values
+ * @tparam Promise promise type of the coroutine
+ */
+template<typename T, typename Promise>
+class generator_base {
+protected:
+    std::coroutine_handle<Promise> handle;
+
+    explicit generator_base(std::coroutine_handle<Promise> handle) : handle{handle} {}
+
+    template<typename Drive>
+    std::optional<T> next_with(Drive &&drive) {
+        if (!handle || handle.done())
+            return std::nullopt;
+
+        handle.promise().value = nullptr;
+        drive(handle);
+
+        if (handle.promise().error)
+            std::rethrow_exception(std::exchange(handle.promise().error, nullptr));
+        if (handle.done())
+            return std::nullopt;
+        return std::make_optional(std::move(*handle.promise().value));
+    }
+
+public:
+    using value_type = T;
+
+    generator_base(const generator_base &other) = delete;
+
+    generator_base(generator_base &&old) noexcept : handle{std::exchange(old.handle, nullptr)} {}
+
+    ~generator_base() {
+        if (handle)
+            handle.destroy();
+    }
+};
+
+template<typename T>
+class generator;
+
+template<typename T>
+class async_generator;
+
+template<typename T>
+struct generator_promise : generator_promise_base<T> {
+    generator<T> get_return_object();
+};
+
+template<typename T>
+struct async_generator_promise : generator_promise_base<T> {
+    // descriptor the coroutine waits for, -1 when it's not waiting
+    int waitingFor = -1;
+
+    async_generator<T> get_return_object();
+};
+
+/**
+ * Iterator implemented by a coroutine, see the top of this file.
+ * @tparam T type of the yielded values
+ */
+template<typename T>
+class generator : public generator_base<T, generator_promise<T>> {
+public:
+    using promise_type = generator_promise<T>;
+
+    explicit generator(std::coroutine_handle<promise_type> handle) : generator_base<T, promise_type>(handle) {}
+
+    generator(generator &&old) noexcept = default;
+
+    std::optional<T> next() {
+        return this->next_with([](auto handle) { handle.resume(); });
+    }
+};
+
+/**
+ * Same as `generator`, but the coroutine can wait for data on non-blocking file descriptors using `read_some`.
+ * @tparam T type of the yielded values
+ */
+template<typename T>
+class async_generator : public generator_base<T, async_generator_promise<T>> {
+public:
+    using promise_type = async_generator_promise<T>;
+
+    explicit async_generator(std::coroutine_handle<promise_type> handle) : generator_base<T, promise_type>(handle) {}
+
+    async_generator(async_generator &&old) noexcept = default;
+
+    std::optional<T> next() {
+        return this->next_with([](auto handle) {
+            handle.resume();
+            while (!handle.done() && handle.promise().waitingFor >= 0) {
+                pollfd fd{handle.promise().waitingFor, POLLIN, 0};
+                while (::poll(&fd, 1, -1) < 0 && errno == EINTR) {}
+                handle.promise().waitingFor = -1;
+                handle.resume();
+            }
+        });
+    }
+};
+
+template<typename T>
+generator<T> generator_promise<T>::get_return_object() {
+    return generator<T>(std::coroutine_handle<generator_promise<T>>::from_promise(*this));
+}
+
+template<typename T>
+async_generator<T> async_generator_promise<T>::get_return_object() {
+    return async_generator<T>(std::coroutine_handle<async_generator_promise<T>>::from_promise(*this));
+}
+
+/**
+ * Awaitable reading from a non-blocking file descriptor inside of an `async_generator`. Suspends the generator only
+ * when there is nothing to read yet.
+ * @return result of `read(2)`, zero at the end of the file
+ */
+struct read_some {
+    int fd;
+    char *buffer;
+    usize size;
+    isize result = -1;
+    bool completed = false;
+
+    read_some(int fd, char *buffer, usize size) : fd{fd}, buffer{buffer}, size{size} {}
+
+    bool try_read() {
+        do {
+            result = ::read(fd, buffer, size);
+        } while (result < 0 && errno == EINTR);
+        completed = result >= 0 || (errno != EAGAIN && errno != EWOULDBLOCK);
+        return completed;
+    }
+
+    bool await_ready() {
+        return try_read();
+    }
+
+    template<typename Promise>
+    void await_suspend(std::coroutine_handle<Promise> handle) {
+        handle.promise().waitingFor = fd;
+    }
+
+    isize await_resume() {
+        // woken up by poll, the data should be there now
+        while (!completed && !try_read()) {
+            pollfd p{fd, POLLIN, 0};
+            ::poll(&p, 1, -1);
+        }
+        return result;
+    }
+};
+
+/**
+ * Yield lines read from the file descriptor, without the newline characters. Reads in large blocks and waits for
+ * the data only when the descriptor is non-blocking and empty.
+ * @param fd descriptor to read from, it's not closed at the end
+ */
+inline async_generator<std::string> read_lines(int fd) {
+    std::string pending;
+    char buffer[1 << 16];
+    while (true) {
+        isize n = co_await read_some(fd, buffer, sizeof(buffer));
+        if (n <= 0)
+            break;
+
+        usize start = 0;
+        for (usize i = 0; i < (usize) n; i++) {
+            if (buffer[i] == '\n') {
+                pending.append(buffer + start, i - start);
+                co_yield std::move(pending);
+                pending.clear();
+                start = i + 1;
+            }
+        }
+        pending.append(buffer + start, n - start);
+    }
+    if (!pending.empty())
+        co_yield std::move(pending);
+}
+
+#endif
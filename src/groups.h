@@ -0,0 +1,59 @@
+#pragma once
+
+#include "types.h"
+#include "people.h"
+#include "trace.h"
+#include <vector>
+#include <unordered_map>
+
+/**
+ * Accumulates shares of transactions paid by or for a whole group without touching the balances of its members.
+ * Every transaction adds only to a single per-(group, currency) counter. The counters are expanded to the members
+ * once, before the debt vectors are used. Group membership never changes after the definition, so the members get
+ * the same amount as if it was added to them one transaction at a time. Only the order of the floating point
+ * additions differs.
+ *
+ * @tparam DebtVector type of the debt vectors the shares belong to
+ */
+template<typename DebtVector>
+class GroupAccumulator {
+private:
+    // debt vector -> share of a single member, indexed by group id
+    std::unordered_map<DebtVector *, std::vector<double>> shares;
+
+public:
+    GroupAccumulator() : shares{} {}
+
+    GroupAccumulator(GroupAccumulator &other) = delete;
+
+    GroupAccumulator(GroupAccumulator &&old) = default;
+
+    GroupAccumulator &operator=(GroupAccumulator &&old) = default;
+
+    /**
+     * Add the supplied amount to the balance of every member of the group.
+     */
+    void add(DebtVector &debtVector, group_id_t group, double share) {
+        auto &groupShares = shares[&debtVector];
+        if (groupShares.size() <= group)
+            groupShares.resize(group + 1, 0.);
+        groupShares[group] += share;
+    }
+
+    /**
+     * Add all accumulated shares to the balances of the group members and reset the counters.
+     */
+    void expand(IDRegister const &people) {
+        trace::Span span("expand groups");
+        for (auto &[debtVector, groupShares] : shares) {
+            for (group_id_t group = 0; group < groupShares.size(); group++) {
+                const double share = groupShares[group];
+                if (share == 0.)
+                    continue;
+                for (auto id : people.get_group_members(group))
+                    debtVector->add(id, share);
+            }
+        }
+        shares.clear();
+    }
+};
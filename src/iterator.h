@@ -7,7 +7,17 @@
 #include <iostream>
 #include <functional>
 #include <type_traits>
+#include <algorithm>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <utility>
+#include <limits>
+#include <string>
+#include <string_view>
 #include "types.h"
+#include "thread_pool.h"
+#include "simd.h"
 
 
 /***
@@ -22,8 +32,178 @@ struct is_iterator {
             !std::is_reference<typename I::value_type>::value; // value_type is not a reference
 };
 
+/**
+ * Non-owning view of a continuous block of values. Used by the batch protocol, because `std::span` is not in C++17.
+ * @tparam T type of the values
+ */
+template<typename T>
+struct Span {
+    T *ptr;
+    usize len;
+
+    Span(T *ptr, usize len) : ptr{ptr}, len{len} {}
+
+    T *begin() const { return ptr; }
+
+    T *end() const { return ptr + len; }
+
+    usize size() const { return len; }
+
+    T &operator[](usize i) const { return ptr[i]; }
+
+    Span subspan(usize offset) const { return Span(ptr + offset, len - offset); }
+};
+
+/***
+ *  Helper for compile-time checks determining if an iterator implements the optional batch protocol:
+ *
+ *      usize next_batch(Span<value_type> out);
+ *
+ *  It moves up to `out.size()` next values into `out` and returns how many were written. Returning less than
+ *  `out.size()` means that the iterator is exhausted.
+ * @tparam I Type to run the check against
+ */
+template<typename I, typename = void>
+struct has_next_batch : std::false_type {};
+
+template<typename I>
+struct has_next_batch<I, std::void_t<decltype(std::declval<I &>().next_batch(
+        std::declval<Span<typename I::value_type>>()))>> : std::is_same<decltype(std::declval<I &>().next_batch(
+        std::declval<Span<typename I::value_type>>())), usize> {};
+
+/***
+ *  Helper for compile-time checks determining if it pays off to consume the iterator in batches. That's when the
+ *  iterator implements the batch protocol natively and its values can be kept in a preallocated buffer.
+ * @tparam I Type to run the check against
+ */
+template<typename I>
+struct is_batchable {
+    constexpr static bool value = has_next_batch<I>::value &&
+                                  std::is_default_constructible_v<typename I::value_type> &&
+                                  std::is_move_assignable_v<typename I::value_type>;
+};
+
+/***
+ *  Helper for compile-time checks determining if an iterator walks over a continuous block of numbers in memory.
+ *  Such iterators implement `remaining()`, which returns a `Span` of the values not returned yet, and `skip_all()`,
+ *  which marks all of them as consumed. Reductions over them can use vector instructions, see `simd.h`.
+ * @tparam I Type to run the check against
+ */
+template<typename I, typename = void>
+struct is_contiguous_iterator : std::false_type {};
+
+template<typename I>
+struct is_contiguous_iterator<I, std::void_t<decltype(std::declval<I &>().remaining()),
+        decltype(std::declval<I &>().skip_all())>> : std::is_arithmetic<typename I::value_type> {};
+
+/***
+ *  Helper for compile-time checks determining if an iterator implements the optional push protocol:
+ *
+ *      template<typename Sink> void push_all(Sink &&sink);
+ *
+ *  It exhausts the iterator and calls `sink` with an rvalue of every remaining value. Sources over ranges in memory
+ *  implement it as a single loop and `map` and `filter` only wrap the sink of the next stage, so a whole pipeline ending
+ *  in `fold` or `collect` compiles into one loop over the memory with all the functions inlined.
+ * @tparam I Type to run the check against
+ */
+template<typename I, typename = void>
+struct has_push_all : std::false_type {};
+
+template<typename I>
+struct has_push_all<I, std::void_t<decltype(std::declval<I &>().push_all(
+        std::declval<void (*)(typename I::value_type &&)>()))>> : std::true_type {};
+
+/***
+ *  Helper for compile-time checks determining if an iterator is lending. Values returned by a lending iterator
+ *  point into its internal buffer and they are valid only until the following call of `next()`. Such iterators define
+ *
+ *      constexpr static bool lending = true;
+ *
+ *  Adaptors which keep values around across multiple calls of `next()`, e.g. `collect()` or `max()`, refuse them.
+ * @tparam I Type to run the check against
+ */
+template<typename I, typename = void>
+struct is_lending : std::false_type {};
+
+template<typename I>
+struct is_lending<I, std::void_t<decltype(I::lending)>> : std::bool_constant<I::lending> {};
+
+/***
+ *  Helper for compile-time checks determining if a type is a view into memory owned by someone else. Mapping values of
+ *  a lending iterator to views keeps the result lending.
+ * @tparam T Type to run the check against
+ */
+template<typename T>
+struct is_view : std::false_type {};
+
+template<>
+struct is_view<std::string_view> : std::true_type {};
+
+template<typename T>
+struct is_view<Span<T>> : std::true_type {};
+
+/**
+ * Bounds of the number of values an iterator is going to return. The lower bound is always valid, the upper one is
+ * missing when it's not known or when the iterator is infinite.
+ */
+using size_hint_t = std::pair<usize, std::optional<usize>>;
+
+/***
+ *  Helper for compile-time checks determining if an iterator implements the optional method
+ *
+ *      size_hint_t size_hint() const;
+ *
+ *  Returning a wrong hint is not a bug, but it may cause needless allocations.
+ * @tparam I Type to run the check against
+ */
+template<typename I, typename = void>
+struct has_size_hint : std::false_type {};
+
+template<typename I>
+struct has_size_hint<I, std::void_t<decltype(std::declval<I const &>().size_hint())>>
+        : std::is_same<decltype(std::declval<I const &>().size_hint()), size_hint_t> {};
+
 namespace {
 
+    // number of values processed at once, when an iterator is consumed in batches
+    constexpr usize BATCH_SIZE = 256;
+
+    /**
+     * Fill the supplied block with the next values of the iterator. Uses the batch protocol when the iterator
+     * implements it, calls `next()` repeatedly otherwise.
+     * @return number of values written, less than `out.size()` only when the iterator is exhausted
+     */
+    template<typename Iter>
+    usize fill_batch(Iter &iter, Span<typename Iter::value_type> out) {
+        if constexpr (has_next_batch<Iter>::value) {
+            return iter.next_batch(out);
+        } else {
+            usize i = 0;
+            for (; i < out.size(); i++) {
+                auto a = iter.next();
+                if (!a)
+                    break;
+                out[i] = std::move(*a);
+            }
+            return i;
+        }
+    }
+
+    /**
+     * @return hint of the iterator, when it does not implement `size_hint()` then nothing is known about it
+     */
+    template<typename Iter>
+    size_hint_t size_hint_of(Iter const &iter) {
+        if constexpr (has_size_hint<Iter>::value)
+            return iter.size_hint();
+        else
+            return size_hint_t(0, std::nullopt);
+    }
+
+    inline usize saturating_add(usize a, usize b) {
+        return a > std::numeric_limits<usize>::max() - b ? std::numeric_limits<usize>::max() : a + b;
+    }
+
 //    This unused class represents an interface, that generic Iterator must implement.
 //
 //    template<typename T>
@@ -47,8 +227,10 @@ namespace {
     private:
         Iter iter;
         Func func;
+        std::vector<typename Iter::value_type> buffer;
     public:
         using value_type = decltype(func(std::declval<typename Iter::value_type>()));
+        constexpr static bool lending = is_lending<Iter>::value && is_view<value_type>::value;
         static_assert(is_iterator<Iter>::value);
         static_assert(std::is_invocable<Func, typename Iter::value_type>());
 
@@ -56,12 +238,30 @@ namespace {
 
         MapIterator(MapIterator &&old) = default;
 
-        MapIterator(Iter &&a, Func &&b) : iter{std::move(a)}, func{std::move(b)} {}
+        MapIterator(Iter &&a, Func &&b) : iter{std::move(a)}, func{std::move(b)}, buffer{} {}
 
         auto next() {
             auto a = iter.next();
             return a ? std::make_optional(func(std::move(*a))) : std::nullopt;
         }
+
+        template<typename T = value_type, typename = std::enable_if_t<is_batchable<Iter>::value, T>>
+        usize next_batch(Span<T> out) {
+            buffer.resize(out.size());
+            usize n = iter.next_batch(Span(buffer.data(), out.size()));
+            for (usize i = 0; i < n; i++)
+                out[i] = func(std::move(buffer[i]));
+            return n;
+        }
+
+        template<typename Sink, typename = std::enable_if_t<has_push_all<Iter>::value, Sink>>
+        void push_all(Sink &&sink) {
+            iter.push_all([this, &sink](typename Iter::value_type &&v) { sink(func(std::move(v))); });
+        }
+
+        size_hint_t size_hint() const {
+            return size_hint_of(iter);
+        }
     };
 
     /**
@@ -79,6 +279,7 @@ namespace {
         Func func;
     public:
         using value_type = typename Iter::value_type;
+        constexpr static bool lending = is_lending<Iter>::value;
         static_assert(is_iterator<Iter>::value);
         static_assert(std::is_invocable_r<bool, Func, value_type>::value);
 
@@ -89,10 +290,44 @@ namespace {
         FilterIterator(Iter &&a, Func &&b) : iter{std::move(a)}, func{std::move(b)} {}
 
         std::optional<value_type> next() {
-            auto a = iter.next();
-            return !a.has_value() ? std::nullopt :
-                   func(*a) ? std::make_optional(*a) :
-                   next();
+            while (auto a = iter.next()) {
+                if (func(*a))
+                    return a;
+            }
+            return std::nullopt;
+        }
+
+        template<typename T = value_type, typename = std::enable_if_t<has_next_batch<Iter>::value, T>>
+        usize next_batch(Span<T> out) {
+            usize kept = 0;
+            while (kept < out.size()) {
+                auto rest = out.subspan(kept);
+                usize n = iter.next_batch(rest);
+                for (usize i = 0; i < n; i++) {
+                    if (!func(rest[i]))
+                        continue;
+                    // moving a value onto itself would leave it empty
+                    if (&out[kept] != &rest[i])
+                        out[kept] = std::move(rest[i]);
+                    kept++;
+                }
+                if (n < rest.size())
+                    break;
+            }
+            return kept;
+        }
+
+        template<typename Sink, typename = std::enable_if_t<has_push_all<Iter>::value, Sink>>
+        void push_all(Sink &&sink) {
+            iter.push_all([this, &sink](value_type &&v) {
+                if (func(v))
+                    sink(std::move(v));
+            });
+        }
+
+        size_hint_t size_hint() const {
+            // any number of the values can be filtered out
+            return size_hint_t(0, size_hint_of(iter).second);
         }
     };
 
@@ -132,6 +367,45 @@ namespace {
         }
     };
 
+    /**
+     * This is NOT meant to be used DIRECTLY. Use method `Iter::file_by_line_views` or `Iter::stdin_by_line_views`
+     * instead.
+     *
+     * Same as `StreamLineIterator`, but it's lending. Lines are read into a single buffer, which is reused for all of
+     * them, and the returned views point into it. So apart from growing the buffer to the longest line, no memory is
+     * allocated.
+     * @tparam stream Type of the data stream
+     */
+    template<class stream>
+    class LendingLineIterator {
+    private:
+        stream in;
+        std::string line;
+    public:
+        using value_type = std::string_view;
+        constexpr static bool lending = true;
+
+        explicit LendingLineIterator(stream &&st) : in{std::move(st)}, line{} {
+            assert(in.good() && "Broken stream...");
+        }
+
+        explicit LendingLineIterator(stream st, bool /*copy*/) : in{st}, line{} {
+            assert(in.good() && "Broken stream...");
+        };
+
+        LendingLineIterator(const LendingLineIterator &old) = delete;
+
+        LendingLineIterator(LendingLineIterator &&old) = default;
+
+        std::optional<std::string_view> next() {
+            if (in.eof() || in.fail() || in.bad())
+                return std::nullopt;
+
+            std::getline(in, line);
+            return std::make_optional(std::string_view(line));
+        }
+    };
+
     /**
      * This is NOT meant to be used DIRECTLY. Use method `Iter::from` instead.
      *
@@ -164,6 +438,87 @@ namespace {
                        return std::make_optional(std::move(retVal));
                    }();
         }
+
+        usize next_batch(Span<value_type> out) {
+            usize i = 0;
+            for (; i < out.size() && _start != _end; i++, _start++)
+                out[i] = std::move(*_start);
+            return i;
+        }
+
+        template<typename Sink>
+        void push_all(Sink &&sink) {
+            for (; _start != _end; _start++) {
+                if constexpr (std::is_const_v<std::remove_reference_t<decltype(*_start)>>)
+                    sink(value_type(*_start));
+                else
+                    sink(std::move(*_start));
+            }
+        }
+
+        size_hint_t size_hint() const {
+            using category = typename std::iterator_traits<ObsoleteIter>::iterator_category;
+            if constexpr (std::is_base_of_v<std::random_access_iterator_tag, category>) {
+                usize n = std::distance(_start, _end);
+                return size_hint_t(n, n);
+            } else {
+                return size_hint_t(_start == _end ? 0 : 1, std::nullopt);
+            }
+        }
+    };
+
+    /**
+     * This is NOT meant to be used DIRECTLY. Use method `Iter::from` instead.
+     *
+     * Iterator over a continuous block of numbers, e.g. `std::vector<double>`. Same as `ObsoleteIteratorConverter`, but
+     * it gives the reductions in `I` direct access to the memory.
+     * @tparam T type of the numbers, possibly const
+     */
+    template<typename T>
+    class ContiguousIterator {
+    private:
+        T *_start;
+        T *_end;
+    public:
+        using value_type = std::remove_cv_t<T>;
+        static_assert(std::is_arithmetic_v<value_type>);
+
+        ContiguousIterator(const ContiguousIterator &other) = delete;
+
+        ContiguousIterator(ContiguousIterator &&old) = default;
+
+        ContiguousIterator(T *start, T *end) : _start{start}, _end{end} {}
+
+        std::optional<value_type> next() {
+            return _start == _end ? std::nullopt : std::make_optional(*_start++);
+        }
+
+        usize next_batch(Span<value_type> out) {
+            usize n = std::min(out.size(), (usize) (_end - _start));
+            std::copy(_start, _start + n, out.begin());
+            _start += n;
+            return n;
+        }
+
+        template<typename Sink>
+        void push_all(Sink &&sink) {
+            const usize n = _end - _start;
+            for (usize i = 0; i < n; i++)
+                sink(value_type(_start[i]));
+            _start = _end;
+        }
+
+        Span<T> remaining() const {
+            return Span<T>(_start, _end - _start);
+        }
+
+        void skip_all() {
+            _start = _end;
+        }
+
+        size_hint_t size_hint() const {
+            return size_hint_t(_end - _start, _end - _start);
+        }
     };
 
     /**
@@ -191,6 +546,16 @@ namespace {
         std::optional<T> next() {
             return std::make_optional(state++);
         }
+
+        usize next_batch(Span<T> out) {
+            for (auto &v : out)
+                v = state++;
+            return out.size();
+        }
+
+        size_hint_t size_hint() const {
+            return size_hint_t(std::numeric_limits<usize>::max(), std::nullopt);
+        }
     };
 
     /**
@@ -208,6 +573,7 @@ namespace {
         Iter iter;
     public:
         using value_type = typename Iter::value_type;
+        constexpr static bool lending = is_lending<Iter>::value;
         static_assert(is_iterator<Iter>::value);
 
         LimitIterator(const LimitIterator &other) = delete;
@@ -222,6 +588,20 @@ namespace {
             count++;
             return iter.next();
         }
+
+        template<typename T = value_type, typename = std::enable_if_t<has_next_batch<Iter>::value, T>>
+        usize next_batch(Span<T> out) {
+            usize wanted = std::min(out.size(), limit - std::min(count, limit));
+            usize n = iter.next_batch(Span(out.ptr, wanted));
+            count += n;
+            return n;
+        }
+
+        size_hint_t size_hint() const {
+            usize left = limit - std::min(count, limit);
+            auto[lower, upper] = size_hint_of(iter);
+            return size_hint_t(std::min(lower, left), std::min(upper.value_or(left), left));
+        }
     };
 
 
@@ -238,29 +618,250 @@ namespace {
     private:
         Iter1 iter1;
         Iter2 iter2;
+        std::vector<typename Iter1::value_type> buffer1;
+        std::vector<typename Iter2::value_type> buffer2;
     public:
         static_assert(is_iterator<Iter1>::value);
         static_assert(is_iterator<Iter2>::value);
         using value_type = std::pair<typename Iter1::value_type, typename Iter2::value_type>;
+        constexpr static bool lending = is_lending<Iter1>::value || is_lending<Iter2>::value;
 
         ZipIterator(const ZipIterator &other) = delete;
 
         ZipIterator(ZipIterator &&old) = default;
 
-        ZipIterator(Iter1 &&iter1, Iter2 &&iter2) : iter1{std::move(iter1)}, iter2{std::move(iter2)} {}
+        ZipIterator(Iter1 &&iter1, Iter2 &&iter2) : iter1{std::move(iter1)}, iter2{std::move(iter2)}, buffer1{},
+                                                    buffer2{} {}
 
         std::optional<value_type> next() {
             auto a = iter1.next();
             auto b = iter2.next();
 
             if (a && b) {
-                return std::optional(std::pair{*a, *b});
+                return std::make_optional(value_type(std::move(*a), std::move(*b)));
             } else {
                 return std::nullopt;
             }
         }
+
+        template<typename T = value_type, typename = std::enable_if_t<
+                is_batchable<Iter1>::value && is_batchable<Iter2>::value, T>>
+        usize next_batch(Span<T> out) {
+            buffer1.resize(out.size());
+            buffer2.resize(out.size());
+            usize n = std::min(iter1.next_batch(Span(buffer1.data(), out.size())),
+                               iter2.next_batch(Span(buffer2.data(), out.size())));
+            for (usize i = 0; i < n; i++)
+                out[i] = value_type(std::move(buffer1[i]), std::move(buffer2[i]));
+            return n;
+        }
+
+        size_hint_t size_hint() const {
+            auto[lower1, upper1] = size_hint_of(iter1);
+            auto[lower2, upper2] = size_hint_of(iter2);
+            std::optional<usize> upper = upper1 && upper2 ? std::make_optional(std::min(*upper1, *upper2))
+                                                          : (upper1 ? upper1 : upper2);
+            return size_hint_t(std::min(lower1, lower2), upper);
+        }
+    };
+
+
+    /**
+     * Hooks of `par_map` around the work on every chunk, e.g. for profiling. Both get the work as a function and must
+     * run it exactly once. `on_read` runs on the thread reading the source, its function returns the number of values
+     * read. `on_map` runs on the worker threads, so it must be safe to call concurrently. The default does nothing.
+     */
+    struct NoChunkHooks {
+        template<typename Read>
+        void on_read(Read &&read) {
+            read();
+        }
+
+        template<typename Map>
+        void on_map(usize, Map &&map) {
+            map();
+        }
     };
 
+    /**
+     * This is NOT meant to be used DIRECTLY. Use method `Iter::par_map` instead.
+     *
+     * Same as `MapIterator`, but the function runs on a pool of worker threads. Values are read from the source in
+     * chunks, every chunk is mapped as a single task and the results are returned in the original order. At most
+     * `maxChunks` chunks are read ahead, so the memory stays bounded even for infinite sources.
+     *
+     * The source itself is read only from the thread calling `next()`, the function must be safe to call from multiple
+     * threads at once. When the function throws, the exception is rethrown from `next()` in place of the value.
+     *
+     * With a single thread, handing the chunks over would cost more than the work itself, so no pool is started and
+     * the values are mapped in `next()` one by one, exactly as `MapIterator` does. The hooks are not called then.
+     * @tparam Iter Type of the source iterator
+     * @tparam Func Function run against values returned by the Iter iterator
+     * @tparam Hooks Default constructible hooks around the work on chunks, see `NoChunkHooks`
+     */
+    template<typename Iter, typename Func, typename Hooks = NoChunkHooks>
+    class ParMapIterator {
+    public:
+        using value_type = std::invoke_result_t<Func, typename Iter::value_type>;
+        // views in the output point at most into the current chunk
+        constexpr static bool lending = is_view<value_type>::value;
+    private:
+        struct Chunk {
+            // copy of the values of a lending source, see `read_input`
+            std::string arena;
+            std::vector<typename Iter::value_type> input;
+            std::vector<value_type> output;
+            // number of values in the chunk, `input` and `output` are touched by the worker
+            usize size = 0;
+            std::exception_ptr error;
+            bool done = false;
+        };
+
+        struct Shared {
+            Func func;
+            Hooks hooks;
+            std::mutex lock;
+            std::condition_variable chunkDone;
+            // must be destroyed first, it waits for the running tasks, nothing when mapping in the calling thread
+            std::optional<ThreadPool> pool;
+
+            Shared(Func func, usize threads) : func{std::move(func)}, hooks{}, pool{} {
+                if (threads > 1)
+                    pool.emplace(threads);
+            }
+        };
+
+        Iter iter;
+        std::unique_ptr<Shared> shared;
+        usize chunkSize;
+        usize maxChunks;
+        bool sourceExhausted = false;
+
+        // reorder buffer, chunks are kept in the order of the source
+        std::deque<std::shared_ptr<Chunk>> chunks;
+        std::shared_ptr<Chunk> current;
+        usize position = 0;
+
+        /**
+         * Read the next chunk of values from the source. Values of a lending source are valid only until the next
+         * call, so they are copied into a single buffer of the chunk and the chunk gets views into it.
+         * @return number of values read
+         */
+        usize read_input(Chunk &chunk) {
+            chunk.input.reserve(chunkSize);
+            if constexpr (is_lending<Iter>::value) {
+                static_assert(std::is_same_v<typename Iter::value_type, std::string_view>,
+                              "Only lending iterators of string views can be mapped in parallel.");
+                std::vector<usize> ends;
+                ends.reserve(chunkSize);
+                while (ends.size() < chunkSize) {
+                    auto a = iter.next();
+                    if (!a) {
+                        sourceExhausted = true;
+                        break;
+                    }
+                    chunk.arena.append(*a);
+                    ends.push_back(chunk.arena.size());
+                }
+                usize start = 0;
+                for (usize end : ends) {
+                    chunk.input.emplace_back(chunk.arena.data() + start, end - start);
+                    start = end;
+                }
+            } else {
+                while (chunk.input.size() < chunkSize) {
+                    auto a = iter.next();
+                    if (!a) {
+                        sourceExhausted = true;
+                        break;
+                    }
+                    chunk.input.push_back(std::move(*a));
+                }
+            }
+            return chunk.input.size();
+        }
+
+        void read_ahead() {
+            while (!sourceExhausted && chunks.size() < maxChunks) {
+                auto chunk = std::make_shared<Chunk>();
+                shared->hooks.on_read([this, &chunk]() { return read_input(*chunk); });
+                if (chunk->input.empty())
+                    break;
+
+                chunk->size = chunk->input.size();
+                chunks.push_back(chunk);
+                shared->pool->submit([chunk, shared = shared.get()]() {
+                    shared->hooks.on_map(chunk->input.size(), [&chunk, shared]() {
+                        try {
+                            chunk->output.reserve(chunk->input.size());
+                            for (auto &value : chunk->input)
+                                chunk->output.push_back(shared->func(std::move(value)));
+                        } catch (...) {
+                            chunk->error = std::current_exception();
+                        }
+                    });
+                    chunk->input = {};
+
+                    std::lock_guard guard(shared->lock);
+                    chunk->done = true;
+                    shared->chunkDone.notify_all();
+                });
+            }
+        }
+
+    public:
+        static_assert(is_iterator<Iter>::value);
+        static_assert(std::is_invocable<Func, typename Iter::value_type>());
+
+        ParMapIterator(const ParMapIterator &other) = delete;
+
+        ParMapIterator(ParMapIterator &&old) = default;
+
+        ParMapIterator(Iter &&a, Func b, usize threads, usize chunkSize, usize maxChunks)
+                : iter{std::move(a)}, shared{std::make_unique<Shared>(std::move(b), threads)},
+                  chunkSize{std::max(chunkSize, (usize) 1)}, maxChunks{std::max(maxChunks, (usize) 1)} {}
+
+        std::optional<value_type> next() {
+            if (!shared->pool) {
+                auto a = iter.next();
+                if (!a)
+                    return std::nullopt;
+                return std::make_optional(shared->func(std::move(*a)));
+            }
+
+            while (!current || position >= current->output.size()) {
+                if (current && current->error)
+                    std::rethrow_exception(current->error);
+
+                read_ahead();
+                if (chunks.empty())
+                    return std::nullopt;
+
+                current = std::move(chunks.front());
+                chunks.pop_front();
+                position = 0;
+                {
+                    std::unique_lock guard(shared->lock);
+                    shared->chunkDone.wait(guard, [this]() { return current->done; });
+                }
+                // let the workers continue while we are consuming this chunk
+                read_ahead();
+            }
+            return std::make_optional(std::move(current->output[position++]));
+        }
+
+        size_hint_t size_hint() const {
+            usize buffered = current ? current->size - std::min(position, current->size) : 0;
+            for (auto const &chunk : chunks)
+                buffered += chunk->size;
+            if (sourceExhausted)
+                return size_hint_t(buffered, buffered);
+
+            auto[lower, upper] = size_hint_of(iter);
+            return size_hint_t(saturating_add(buffered, lower),
+                               upper ? std::make_optional(saturating_add(buffered, *upper)) : std::nullopt);
+        }
+    };
 
 }
 
@@ -280,6 +881,7 @@ template<typename Iter>
 class I {
 public:
     using value_type = typename Iter::value_type;
+    constexpr static bool lending = is_lending<Iter>::value;
 private:
     std::optional<Iter> iter;
     std::optional<value_type> last_value_for_oldschool_iter = {};
@@ -289,6 +891,86 @@ private:
         return I<OtherIter>(std::forward<OtherIter>(iter));
     }
 
+    /**
+     * Find the first value which is better than all the values after it. The values are only moved, never copied.
+     * @tparam Compare comparison of values, returns true when the first value is better
+     */
+    template<typename Compare>
+    std::optional<value_type> best(Compare &&better) {
+        static_assert(!lending, "Values of a lending iterator are valid only until the next call, map them to owned values first.");
+        auto result = iter->next();
+        if (!result)
+            return std::nullopt;
+
+        while (auto a = iter->next()) {
+            if (better(*a, *result))
+                result = std::move(a);
+        }
+        return result;
+    }
+
+    /**
+     * Find the first value whose key is better than keys of all the values after it. The key is computed only once for
+     * every value and the values are only moved, never copied.
+     * @tparam Func function computing the key from a const reference to the value
+     * @tparam Compare comparison of keys, returns true when the first key is better
+     */
+    template<typename Func, typename Compare>
+    std::optional<value_type> best_by(Func &&f, Compare &&better) {
+        static_assert(!lending, "Values of a lending iterator are valid only until the next call, map them to owned values first.");
+        auto best = iter->next();
+        if (!best)
+            return std::nullopt;
+
+        auto bestKey = f(std::as_const(*best));
+        while (auto a = iter->next()) {
+            auto key = f(std::as_const(*a));
+            if (better(key, bestKey)) {
+                bestKey = std::move(key);
+                best = std::move(a);
+            }
+        }
+        return best;
+    }
+
+    /**
+     * Exhaust the iterator and run the function for every value. Uses the push protocol when the iterator implements
+     * it, the batch protocol when it pays off and `next()` otherwise.
+     * @tparam Func function taking a reference to the value, it may move the value out
+     */
+    template<typename Func>
+    void for_each_value(Func &&f) {
+        if constexpr (has_push_all<Iter>::value) {
+            iter->push_all([&f](value_type &&v) { f(v); });
+        } else if constexpr (is_batchable<Iter>::value) {
+            std::vector<value_type> buffer(BATCH_SIZE);
+            while (true) {
+                usize n = iter->next_batch(Span(buffer.data(), buffer.size()));
+                for (usize i = 0; i < n; i++)
+                    f(buffer[i]);
+                if (n < buffer.size())
+                    break;
+            }
+        } else {
+            while (auto a = iter->next())
+                f(*a);
+        }
+    }
+
+    template<typename Container, typename = void>
+    struct is_reservable : std::false_type {};
+
+    template<typename Container>
+    struct is_reservable<Container, std::void_t<decltype(std::declval<Container &>().reserve((usize) 0))>>
+            : std::true_type {};
+
+    template<typename Container, typename = void>
+    struct has_push_back : std::false_type {};
+
+    template<typename Container>
+    struct has_push_back<Container, std::void_t<decltype(std::declval<Container &>().push_back(
+            std::declval<value_type>()))>> : std::true_type {};
+
 public:
 
     I(I &&old) = default;
@@ -314,6 +996,27 @@ public:
         return wrap_iter(std::move(mi));
     }
 
+    /**
+     * Same as `map`, but the function runs in parallel on a pool of worker threads. The values are still returned in
+     * the original order, so the following stages of the pipeline see no difference. The source is read ahead by at
+     * most `4 * threads` chunks. With a single thread, the values are mapped in the calling thread as by `map`.
+     * @tparam Func Transformation function, must be safe to call from multiple threads at once
+     * @tparam Hooks hooks around the reading and mapping of every chunk, see `NoChunkHooks`
+     * @param f the function
+     * @param threads number of worker threads
+     * @param chunkSize number of values mapped by a single task
+     * @return instance of Self
+     */
+    template<typename Hooks = NoChunkHooks, typename Func>
+    auto par_map(Func &&f, usize threads = std::thread::hardware_concurrency(), usize chunkSize = 1024) {
+        assert(iter);
+        threads = std::max(threads, (usize) 1);
+        ParMapIterator<Iter, std::decay_t<Func>, Hooks> pi(std::move(*iter), std::forward<Func>(f), threads,
+                                                           chunkSize, 4 * threads);
+        iter.reset();
+        return wrap_iter(std::move(pi));
+    }
+
     /**
      * Add function which will run for every element of the iterator to the iterator pipeline and return the new iterator.
      * The function is evaluated lazily, so it will not run, when `next()` is not called.
@@ -341,12 +1044,7 @@ public:
     template<typename Func>
     void into(Func &&f) {
         assert(iter);
-        MapIterator mi(std::move(*iter), [=](value_type p) {
-            f(std::move(p));
-            return 0;
-        });
-        iter.reset();
-        wrap_iter(std::move(mi)).exhaust();
+        for_each_value([&f](value_type &v) { f(std::move(v)); });
     }
 
     /**
@@ -358,7 +1056,7 @@ public:
     template<typename Func>
     auto filter(Func &&f) {
         assert(iter);
-        FilterIterator<Iter, Func> fi(std::move(*iter), f);
+        FilterIterator<Iter, Func> fi(std::move(*iter), std::forward<Func>(f));
         iter.reset();
         return wrap_iter(std::move(fi));
     }
@@ -373,22 +1071,78 @@ public:
     }
 
     /**
-     * Collect the values of the iterator into a `std::vector`
+     * Get next block of elements of the iterator, available only when the wrapped iterator supports the batch
+     * protocol. See `has_next_batch`.
+     * @return Number of values written into the block
+     */
+    template<typename T = value_type, typename = std::enable_if_t<has_next_batch<Iter>::value, T>>
+    usize next_batch(Span<T> out) {
+        assert(iter);
+        return iter->next_batch(out);
+    }
+
+    /**
+     * Exhaust the iterator and pass every value to the sink, available only when the wrapped iterator supports the
+     * push protocol. See `has_push_all`.
+     */
+    template<typename Sink, typename = std::enable_if_t<has_push_all<Iter>::value, Sink>>
+    void push_all(Sink &&sink) {
+        assert(iter);
+        iter->push_all(std::forward<Sink>(sink));
+    }
+
+    /**
+     * Bounds of the number of the remaining values, see `size_hint_t`.
+     */
+    size_hint_t size_hint() const {
+        assert(iter);
+        return size_hint_of(*iter);
+    }
+
+    /**
+     * Collect the values of the iterator into a `std::vector`. The vector is allocated only once, when the iterator
+     * knows its length, see `size_hint()`.
      * @return Vector with the values...
      */
     auto collect() {
-        assert(iter);
         std::vector<value_type> result;
-        while (auto a = (*iter).next()) result.push_back(*a);
+        collect_into(result);
         return result;
     }
 
+    /**
+     * Append the values of the iterator to the supplied container. Uses `push_back` when the container has it,
+     * `insert` otherwise. When the container can `reserve` and the iterator is finite, the space for at least
+     * the lower bound of `size_hint()` is reserved up front.
+     * @param container e.g. `std::vector`, `std::deque` or `std::set`
+     * @return the same container
+     */
+    template<typename Container>
+    Container &collect_into(Container &container) {
+        static_assert(!lending, "Values of a lending iterator are valid only until the next call, map them to owned values first.");
+        assert(iter);
+        if constexpr (is_reservable<Container>::value) {
+            auto[lower, upper] = size_hint();
+            if (upper && lower > 0)
+                container.reserve(container.size() + lower);
+        }
+
+        auto append = [&container](value_type &v) {
+            if constexpr (has_push_back<Container>::value)
+                container.push_back(std::move(v));
+            else
+                container.insert(std::move(v));
+        };
+        for_each_value(append);
+        return container;
+    }
+
     /**
      * Exhausts the iterator. Calls the `next()` function for as long as it returns something.
      */
     void exhaust() {
         assert(iter);
-        while (iter->next()) {}
+        for_each_value([](value_type &) {});
     }
 
     /**
@@ -421,13 +1175,33 @@ public:
         static_assert(!std::is_reference_v<State>, "State in fold can't be reference.");
 
         assert(iter);
-        while (auto a = iter->next()) {
-            State ss = f(std::move(*a), std::forward<State>(s));
+        for_each_value([&f, &s](value_type &v) {
+            State ss = f(std::move(v), std::forward<State>(s));
             s = std::move(ss);
-        }
+        });
         return std::forward<State>(s);
     }
 
+    /**
+     * Same as `fold`, but the state is not passed through the function by value. The function gets a reference to
+     * the state and mutates it in place, so the state is never moved while iterating. Useful for large states.
+     *
+     * @tparam Func
+     * @tparam State
+     * @param f function taking the item and a reference to the state, its return value is ignored
+     * @param s initial state
+     * @return state after aggregation with all the items in the iterator
+     */
+    template<typename Func, typename State>
+    State fold_mut(Func &&f, State &&s) {
+        static_assert(!std::is_reference_v<State>, "State in fold_mut can't be reference.");
+        static_assert(std::is_invocable_v<Func, typename Iter::value_type, State &>);
+
+        assert(iter);
+        for_each_value([&f, &s](value_type &v) { f(std::move(v), s); });
+        return std::move(s);
+    }
+
     /**
      * Same as fold, takes the first value of the iterator as the initial. Returns the resulting state in an option due
      * to the possibility of the iterator being empty.
@@ -441,6 +1215,7 @@ public:
         static_assert(std::is_same_v<typename Iter::value_type, decltype(f(std::declval<typename Iter::value_type>(),
                                                                            std::declval<typename Iter::value_type>()))>,
                       "Return type is not the same as iterator type!");
+        static_assert(!lending, "Values of a lending iterator are valid only until the next call, map them to owned values first.");
         assert(iter);
         auto first = iter->next();
         if (!first) {
@@ -522,11 +1297,17 @@ public:
 
     /**
      * Sums the values in the iterator and returns the result.
-     * @return the sum of all values
+     * @return the sum of all values, of the same type as the values, it starts from a value-initialized one
      */
-    auto sum() {
+    typename Iter::value_type sum() {
         assert(iter);
-        return fold([](auto v, auto s) { return v + s; }, (usize) 0);
+        if constexpr (is_contiguous_iterator<Iter>::value) {
+            auto values = iter->remaining();
+            iter->skip_all();
+            return simd::sum(values.ptr, values.size());
+        } else {
+            return fold([](auto v, auto s) { return v + s; }, typename Iter::value_type{});
+        }
     }
 
     /**
@@ -545,7 +1326,12 @@ public:
      */
     std::optional<typename Iter::value_type> max() {
         assert(iter);
-        return reduce([](auto a, auto b) { return a > b ? a : b; });
+        if constexpr (is_contiguous_iterator<Iter>::value) {
+            auto found = argmax();
+            return found ? std::make_optional(found->second) : std::nullopt;
+        } else {
+            return best(std::greater<>());
+        }
     }
 
     /**
@@ -558,7 +1344,7 @@ public:
     template<typename Func>
     std::optional<typename Iter::value_type> max_by(Func &&f) {
         assert(iter);
-        return reduce([=](auto a, auto b) { return f(a) > f(b) ? a : b; });
+        return best_by(std::forward<Func>(f), std::greater<>());
     }
 
     /**
@@ -567,7 +1353,82 @@ public:
      */
     std::optional<typename Iter::value_type> min() {
         assert(iter);
-        return reduce([](auto a, auto b) { return a < b ? a : b; });
+        if constexpr (is_contiguous_iterator<Iter>::value) {
+            auto found = argmin();
+            return found ? std::make_optional(found->second) : std::nullopt;
+        } else {
+            return best(std::less<>());
+        }
+    }
+
+    /**
+     * Returns the first maximal item of the iterator together with its position.
+     * @return same as `enumerate().max_by(...)` comparing the values
+     */
+    std::optional<std::pair<usize, value_type>> argmax() {
+        auto found = argminmax();
+        return found ? std::make_optional(std::move(found->second)) : std::nullopt;
+    }
+
+    /**
+     * Returns the first minimal item of the iterator together with its position.
+     * @return same as `enumerate().min_by(...)` comparing the values
+     */
+    std::optional<std::pair<usize, value_type>> argmin() {
+        auto found = argminmax();
+        return found ? std::make_optional(std::move(found->first)) : std::nullopt;
+    }
+
+    /**
+     * Returns both the first minimal and the first maximal item of the iterator together with their positions in
+     * a single pass.
+     * @return pair of (position, value) pairs, the minimum goes first
+     */
+    std::optional<std::pair<std::pair<usize, value_type>, std::pair<usize, value_type>>> argminmax() {
+        assert(iter);
+        if constexpr (is_contiguous_iterator<Iter>::value) {
+            auto values = iter->remaining();
+            iter->skip_all();
+            if (values.size() == 0)
+                return std::nullopt;
+            auto[min, max] = simd::argminmax(values.ptr, values.size());
+            return std::make_optional(std::make_pair(std::make_pair(min, values[min]), std::make_pair(max, values[max])));
+        } else {
+            auto found = enumerate().minmax_by([](auto const &p) -> value_type const & { return p.second; });
+            return found ? std::make_optional(std::move(*found)) : std::nullopt;
+        }
+    }
+
+    /**
+     * Returns both the first minimal and the first maximal item of the iterator in a single pass. The comparison is
+     * done on values returned by the supplied function, it is called only once for every item.
+     * @tparam Func
+     * @param f function transforming a const reference to the item into a comparable element
+     * @return pair of the minimal and maximal item
+     */
+    template<typename Func>
+    std::optional<std::pair<value_type, value_type>> minmax_by(Func &&f) {
+        static_assert(!lending, "Values of a lending iterator are valid only until the next call, map them to owned values first.");
+        assert(iter);
+        auto first = iter->next();
+        if (!first)
+            return std::nullopt;
+
+        value_type min = *first;
+        value_type max = std::move(*first);
+        auto minKey = f(std::as_const(min));
+        auto maxKey = minKey;
+        while (auto a = iter->next()) {
+            auto key = f(std::as_const(*a));
+            if (key < minKey) {
+                minKey = key;
+                min = std::move(*a);
+            } else if (maxKey < key) {
+                maxKey = std::move(key);
+                max = std::move(*a);
+            }
+        }
+        return std::make_optional(std::make_pair(std::move(min), std::move(max)));
     }
 
     /**
@@ -579,12 +1440,25 @@ public:
     template<typename Func>
     std::optional<typename Iter::value_type> min_by(Func &&f) {
         assert(iter);
-        return reduce([=](auto a, auto b) { return f(a) < f(b) ? a : b; });
+        return best_by(std::forward<Func>(f), std::less<>());
     }
 };
 
 namespace Iter {
 
+    /***
+     *  Helper for compile-time checks determining if `Iter::from` can walk the container directly in memory. True for
+     *  `std::vector` and `std::array` of numbers.
+     */
+    template<typename Container, typename = void>
+    struct is_contiguous_container : std::false_type {};
+
+    template<typename Container>
+    struct is_contiguous_container<Container, std::void_t<decltype(std::declval<Container &>().data()),
+            decltype(std::declval<Container &>().size())>>
+            : std::is_arithmetic<std::remove_cv_t<std::remove_pointer_t<
+                    decltype(std::declval<Container &>().data())>>> {};
+
     /**
      * Given an initial value, continue by incrementing the value to infinity and return the resulting iterator.
      * @tparam T
@@ -632,6 +1506,24 @@ namespace Iter {
         return I(StreamLineIterator<std::istream &>(std::cin, false));
     }
 
+    /**
+     * Same as `file_by_lines`, but the iterator is lending. It returns views of the lines, which are valid only until
+     * the next line is read, and it does not allocate memory for every line.
+     * @param file filename
+     * @return
+     */
+    auto file_by_line_views(const std::string &file) {
+        return I(LendingLineIterator<std::ifstream>(std::ifstream(file)));
+    }
+
+    /**
+     * Same as `stdin_by_lines`, but the iterator is lending. See `file_by_line_views`.
+     * @return
+     */
+    auto stdin_by_line_views() {
+        return I(LendingLineIterator<std::istream &>(std::cin, false));
+    }
+
     /**
      * Zip two iterators together returning an iterator of pairs
      *
@@ -656,7 +1548,10 @@ namespace Iter {
      */
     template<typename Container>
     auto from(Container &&vec) {
-        return I(std::move(ObsoleteIteratorConverter(vec.begin(), vec.end())));
+        if constexpr (is_contiguous_container<Container>::value)
+            return I(ContiguousIterator(vec.data(), vec.data() + vec.size()));
+        else
+            return I(std::move(ObsoleteIteratorConverter(vec.begin(), vec.end())));
     }
 
     /**
@@ -667,6 +1562,9 @@ namespace Iter {
      */
     template<typename Container>
     auto from(Container &vec) {
-        return I(std::move(ObsoleteIteratorConverter(vec.begin(), vec.end())));
+        if constexpr (is_contiguous_container<Container>::value)
+            return I(ContiguousIterator(vec.data(), vec.data() + vec.size()));
+        else
+            return I(std::move(ObsoleteIteratorConverter(vec.begin(), vec.end())));
     }
 }
\ No newline at end of file
@@ -1,45 +1,173 @@
 #include <iostream>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
 #include "iterator.h"
 #include "parser.h"
 #include "balancer.h"
 #include "simplifier.h"
+#include "writer.h"
+#include "stats.h"
+#include "alloc_tracker.h"
+#include "trace.h"
+#include "server.h"
 
 using std::optional;
 using std::make_optional;
 using std::nullopt;
 using std::move;
 
-int main(int argc, char ** argv) {
-    if (argc > 1) {
-        std::cout << "This program takes all its input through stdin. No arguments are allowed." << std::endl;
-        return 0;
-    }
+/**
+ * The whole program. The version with statistics is compiled separately, so that the normal one has no overhead.
+ */
+template<bool withStats>
+void run(PipelineStats &stats, OutputWriter &out, usize threads) {
+    // reading of the input is not tagged by any of the stages
+    ALLOC_SCOPE(parser);
+
+    auto const advance = [&stats](model::ConfigElement &&element, BalancingState &state) {
+        if constexpr (withStats)
+            stats.record(element, state.people);
+        timed<withStats>(stats.balance, advance_state)(move(element), state);
+    };
 
-    //BalancingState result = Iter::file_by_lines("./tests/inputs/bigga.txt")
-    BalancingState result = Iter::stdin_by_lines()
+    //BalancingState result = Iter::file_by_line_views("./tests/inputs/bigga.txt")
+    BalancingState result = I(timed_source<withStats>(stats.reading, LendingLineIterator<std::istream &>(std::cin, false)))
+            .lazy_for_each(observe<withStats || alloc::ENABLED>([&stats](std::string_view line) {
+                if constexpr (withStats)
+                    stats.read(line);
+                alloc::count_line();
+            }))
             .filter(empty_filter)
             .filter(comment_filter)
-            .map(token_splitter)
+            .template par_map<trace::ChunkSpans>(timed<withStats>(stats.tokenize, token_splitter), threads)
             .filter(empty_filter)
-            .map(line_parser)
-            .lazy_for_each(print_definitions)
-            .fold(advance_state, BalancingState());
+            .map(timed<withStats>(stats.parse, line_parser))
+            .lazy_for_each(print_definitions(out))
+            .fold_mut(advance, BalancingState());
+
+    Stopwatch stage;
+    if constexpr (withStats) {
+        stats.ingestWall = stats.total.wall_seconds();
+        stats.ingestCpu = stats.total.cpu_seconds();
+    }
 
-    std::cout << std::endl;
+    settle(result);
+
+    if constexpr (withStats) {
+        stats.settleWall = stage.wall_seconds();
+        stats.settleCpu = stage.cpu_seconds();
+        stage = Stopwatch();
+    }
+
+    out << '\n';
     auto people = move(result.people);
 
-    Iter::from(move(result.currencies)).into([&people](auto &&cdv) {
+    Iter::from(move(result.currencies)).into([&people, &out, &stats](auto &&cdv) {
+        ALLOC_SCOPE(simplifier);
+        trace::Span span("simplify");
         auto currency = move(cdv.first);
-        auto debtVector = move(cdv.second);
-        SimplifiedTransactionGenerator::create(move(debtVector))
-                .map([&currency, &people](SimpleTransaction st) {
-                    return st.to_full_transaction(people, currency);
-                })
-                .lazy_for_each([](auto const &transaction) { std::cout << transaction << std::endl; })
-                .exhaust();
+        span.set_detail(currency);
+        auto[ids, debtVector] = cdv.second.nonzero();
+        u64 involved = ids.size();
+        u64 transactions = 0;
+        SimplifiedTransactionGenerator::create(move(ids), move(debtVector))
+                .into([&currency, &people, &out, &transactions](SimpleTransaction st) {
+                    st.write_to(out, people, currency);
+                    transactions++;
+                });
+        span.set_count(transactions);
+        if constexpr (withStats)
+            stats.simplified[currency] = std::make_pair(involved, transactions);
         return 0;
     });
 
+    if constexpr (withStats) {
+        stats.simplifyWall = stage.wall_seconds();
+        stats.simplifyCpu = stage.cpu_seconds();
+    }
+}
+
+/**
+ * Load the ledger from stdin and answer requests about it on the socket, see `LedgerServer`.
+ */
+int serve(const char *socketPath, usize threads) {
+    BalancingState state = Iter::stdin_by_line_views()
+            .filter(empty_filter)
+            .filter(comment_filter)
+            .par_map(token_splitter, threads)
+            .filter(empty_filter)
+            .map(line_parser)
+            .fold_mut(advance_state, BalancingState());
+
+    LedgerServer server(move(state));
+    try {
+        server.listen(socketPath);
+        server.serve();
+    } catch (std::runtime_error const &e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char ** argv) {
+    const char *traceFlag = "--trace=";
+    const char *serveFlag = "--serve=";
+    const char *threadsFlag = "--threads=";
+    const char *socketPath = nullptr;
+    bool withStats = false;
+    // tokenizing is too cheap to pay for handing the lines over to other threads, unless asked for
+    usize threads = 1;
+    std::ofstream traceFile;
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--stats") == 0) {
+            withStats = true;
+        } else if (std::strncmp(argv[i], traceFlag, std::strlen(traceFlag)) == 0) {
+            traceFile.open(argv[i] + std::strlen(traceFlag));
+            if (!traceFile) {
+                std::cerr << "Can't open the trace file \"" << argv[i] + std::strlen(traceFlag) << "\"" << std::endl;
+                return 1;
+            }
+            trace::start();
+        } else if (std::strncmp(argv[i], serveFlag, std::strlen(serveFlag)) == 0) {
+            socketPath = argv[i] + std::strlen(serveFlag);
+        } else if (std::strncmp(argv[i], threadsFlag, std::strlen(threadsFlag)) == 0) {
+            threads = std::strtoul(argv[i] + std::strlen(threadsFlag), nullptr, 10);
+            if (threads == 0) {
+                std::cerr << "The number of threads must be positive" << std::endl;
+                return 1;
+            }
+        } else {
+            std::cout << "This program takes all its input through stdin. The allowed arguments are --stats, which"
+                         " writes statistics of the run to stderr as JSON, and --trace=<file>, which writes spans of"
+                         " the run into the file as Chrome trace events. With --serve=<socket>, the ledger is kept in"
+                         " memory and requests are answered on the Unix socket. With --threads=<n>, the input is"
+                         " tokenized on n threads." << std::endl;
+            return 0;
+        }
+    }
+    if (socketPath)
+        return serve(socketPath, threads);
+
+    PipelineStats stats;
+    {
+        OutputWriter out;
+        // definitions printed before an invalid line are not lost
+        flushed_on_error(out, [&stats, &out, withStats, threads]() {
+            if (withStats)
+                run<true>(stats, out, threads);
+            else
+                run<false>(stats, out, threads);
+        });
+    }
+    if (withStats)
+        stats.write_json(std::cerr);
+    if constexpr (alloc::ENABLED)
+        alloc::write_report(std::cerr);
+    if (trace::enabled())
+        trace::write_chrome_json(traceFile);
+
     return 0;
 
-}
\ No newline at end of file
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "types.h"
+#include "writer.h"
 #include <vector>
 #include <string>
 #include <unordered_map>
@@ -24,9 +25,15 @@ namespace model {
 
         friend std::ostream &operator<<(std::ostream &os, const Person &person) {
             os << "def person " << person.name;
-            for (auto al : person.aliases) os << " " << al;
+            for (auto const &al : person.aliases) os << " " << al;
             return os;
         }
+
+        friend OutputWriter &operator<<(OutputWriter &out, const Person &person) {
+            out << "def person " << person.name;
+            for (auto const &al : person.aliases) out << ' ' << al;
+            return out;
+        }
     };
 
     struct Group {
@@ -39,9 +46,15 @@ namespace model {
 
         friend std::ostream &operator<<(std::ostream &os, const Group &group) {
             os << "def group " << group.name;
-            for (auto mt : group.mapsTo) os << " " << mt;
+            for (auto const &mt : group.mapsTo) os << " " << mt;
             return os;
         }
+
+        friend OutputWriter &operator<<(OutputWriter &out, const Group &group) {
+            out << "def group " << group.name;
+            for (auto const &mt : group.mapsTo) out << ' ' << mt;
+            return out;
+        }
     };
     struct Currency {
         string name;
@@ -55,6 +68,10 @@ namespace model {
             return os;
         }
 
+        friend OutputWriter &operator<<(OutputWriter &out, const Currency &currency) {
+            return out << "def currency " << currency.name;
+        }
+
         bool operator==(const Currency &other) const {
             return this->name == other.name;
         }
@@ -67,6 +84,10 @@ namespace model {
         return os;
     }
 
+    inline OutputWriter &operator<<(OutputWriter &out, const Value &val) {
+        return out << std::get<0>(val) << std::get<1>(val).name;
+    }
+
     using CurrencyTransformation = std::pair<Value, Value>;
 
     std::ostream &operator<<(std::ostream &os, const CurrencyTransformation &trans) {
@@ -74,6 +95,10 @@ namespace model {
         return os;
     }
 
+    inline OutputWriter &operator<<(OutputWriter &out, const CurrencyTransformation &trans) {
+        return out << "convert " << std::get<0>(trans) << " to " << std::get<1>(trans);
+    }
+
     struct Transaction {
         vector<string> paidBy;
         std::pair<double, string> value;
@@ -84,13 +109,22 @@ namespace model {
         Transaction(Transaction&& old): paidBy{std::move(old.paidBy)}, value{std::move(old.value)}, paidFor{std::move(old.paidFor)}{}
 
         friend std::ostream &operator<<(std::ostream &out, const Transaction &transaction) {
-            for (auto p : transaction.paidBy)
+            for (auto const &p : transaction.paidBy)
                 out << p << " ";
             out << "paid " << transaction.value.first << transaction.value.second << " for";
-            for (auto p : transaction.paidFor)
+            for (auto const &p : transaction.paidFor)
                 out << " " << p;
             return out;
         }
+
+        friend OutputWriter &operator<<(OutputWriter &out, const Transaction &transaction) {
+            for (auto const &p : transaction.paidBy)
+                out << p << ' ';
+            out << "paid " << transaction.value.first << transaction.value.second << " for";
+            for (auto const &p : transaction.paidFor)
+                out << ' ' << p;
+            return out;
+        }
     };
 
     using ConfigElement = std::variant<Person, Group, Currency, Transaction, CurrencyTransformation>;
@@ -2,34 +2,26 @@
 
 #include "types.h"
 #include <string>
+#include <string_view>
 #include <set>
 #include <vector>
 #include <cassert>
 #include "model.h"
+#include "alloc_tracker.h"
 #include <exception>
 
-auto constexpr token_splitter = [](std::string &&line) -> std::vector<std::string> {
-    std::string::iterator it = line.begin();
+auto constexpr token_splitter = [](std::string_view line) -> std::vector<std::string> {
+    ALLOC_SCOPE(parser);
     std::vector<std::string> result;
 
-    std::string word;
-    while (it != line.end()) {
-        if (!isspace(*it)) {
-            // this is not delimiter
-            word.push_back(*it);
-        } else {
+    usize start = 0;
+    for (usize i = 0; i <= line.size(); i++) {
+        if (i == line.size() || isspace((unsigned char) line[i])) {
             // this is a delimiter
-            if (!word.empty()) {
-                result.push_back(word);
-                word.clear();
-            }
+            if (i > start)
+                result.emplace_back(line.substr(start, i - start));
+            start = i + 1;
         }
-        ++it;
-    }
-
-    if (!word.empty()) {
-        result.push_back(word);
-        word.clear();
     }
 
     return result;
@@ -39,7 +31,7 @@ auto constexpr empty_filter = [](auto const &line) {
     return !line.empty();
 };
 
-auto constexpr comment_filter = [](std::string const &line) {
+auto constexpr comment_filter = [](std::string_view line) {
     assert(line.size() > 0);
     return line[0] != '#';
 };
@@ -133,6 +125,7 @@ namespace {
 }
 
 auto constexpr line_parser = [](std::vector<std::string> line) -> model::ConfigElement {
+    ALLOC_SCOPE(parser);
     assert(line.size() > 0);
     if (line.at(0) == "def") {
         if (line.at(1) == "person") {
@@ -151,12 +144,22 @@ auto constexpr line_parser = [](std::vector<std::string> line) -> model::ConfigE
     };
 };
 
-auto constexpr print_definitions = [](const model::ConfigElement& element) {
-    std::visit(overloaded {
-            [](const model::Person& arg) { std::cout << arg << std::endl; },
-            [](const model::Currency& arg) { std::cout << arg << std::endl; },
-            [](const model::Group& arg) { std::cout << arg << std::endl; },
-            [](const model::CurrencyTransformation& arg) { std::cout << arg << std::endl; },
-            [](const auto& _) {},
-    }, element);
-};
+/**
+ * @tparam Out `OutputWriter` or `std::ostream`
+ * @return function printing definitions into the supplied output, one per line. The names are copied straight into
+ * the output, which is exactly the line with its whitespace collapsed, only the amounts of conversions are formatted.
+ * The original bytes of the line are not passed through instead, the amounts would then be printed as written, e.g.
+ * `1.00eur` instead of `1eur`.
+ */
+template<typename Out>
+auto print_definitions(Out &out) {
+    return [&out](const model::ConfigElement& element) {
+        std::visit(overloaded {
+                [&out](const model::Person& arg) { out << arg << '\n'; },
+                [&out](const model::Currency& arg) { out << arg << '\n'; },
+                [&out](const model::Group& arg) { out << arg << '\n'; },
+                [&out](const model::CurrencyTransformation& arg) { out << arg << '\n'; },
+                [](const auto& _) {},
+        }, element);
+    };
+}
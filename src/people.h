@@ -1,13 +1,17 @@
 #pragma once
 
-#include <unordered_set>
 #include <unordered_map>
 #include <string>
+#include <vector>
+#include <algorithm>
+#include <optional>
+#include <cstdint>
 #include "types.h"
 #include "iterator.h"
 #include "model.h"
 
 using person_id_t = usize;
+using group_id_t = usize;
 
 /**
  * This class stores mapping between people's names and their internal numerial identifiers. The same also for groups.
@@ -16,7 +20,8 @@ class IDRegister {
 private:
     std::vector<std::string> canonicalPersonNames;
     std::unordered_map <std::string, person_id_t> registry;
-    std::unordered_map <std::string, std::unordered_set<person_id_t>> groupRegistry;
+    std::unordered_map <std::string, group_id_t> groupRegistry;
+    std::vector<std::vector<person_id_t>> groups;
 
     void add_person_alias(std::string name, person_id_t id) {
         auto[col, success] = registry.insert({name, id});
@@ -35,29 +40,25 @@ private:
         return id;
     }
 
-    std::unordered_set<person_id_t> &create_group_record(std::string name) {
-        auto[col, success] = groupRegistry.insert({name, std::unordered_set<person_id_t>{}});
+    std::vector<person_id_t> &create_group_record(std::string name) {
+        auto[col, success] = groupRegistry.insert({name, groups.size()});
         if (!success) {
             std::cerr << "Group with name \"" << name << "\" is defined twice!" << std::endl;
             throw "Person definition occured for the second time with the same name";
         } else {
-            return groupRegistry.at(name);
+            groups.emplace_back();
+            return groups.back();
         }
     }
 
 public:
-    IDRegister() : registry{}, groupRegistry{} {}
+    IDRegister() : registry{}, groupRegistry{}, groups{} {}
 
     IDRegister(IDRegister &other) = delete;
 
-    IDRegister(IDRegister &&old) : canonicalPersonNames{std::move(old.canonicalPersonNames)}, registry{std::move(old.registry)} {}
+    IDRegister(IDRegister &&old) = default;
 
-    IDRegister &operator=(IDRegister &&old) {
-        std::swap(registry, old.registry);
-        std::swap(groupRegistry, old.groupRegistry);
-        std::swap(canonicalPersonNames, old.canonicalPersonNames);
-        return *this;
-    }
+    IDRegister &operator=(IDRegister &&old) = default;
 
     void add_person(model::Person person) {
         auto id = register_person(std::move(person.name));
@@ -76,8 +77,43 @@ public:
         return registry.find(name) != registry.end();
     }
 
-    std::unordered_set<person_id_t> const &get_group_members(std::string &name) const {
-        return groupRegistry.at(name);
+    /**
+     * @return ids of all members of the group, every person is there only once
+     */
+    std::vector<person_id_t> const &get_group_members(std::string &name) const {
+        return groups.at(groupRegistry.at(name));
+    }
+
+    std::vector<person_id_t> const &get_group_members(const group_id_t id) const {
+        return groups[id];
+    }
+
+    usize get_number_of_groups() const {
+        return groups.size();
+    }
+
+    /**
+     * Same as `get_group_members`, but returns `nullptr` when there is no such group.
+     */
+    std::vector<person_id_t> const *find_group(const std::string &name) const {
+        auto res = groupRegistry.find(name);
+        return res == groupRegistry.end() ? nullptr : &groups[res->second];
+    }
+
+    /**
+     * @return id of the group or nothing, when there is no such group
+     */
+    std::optional<group_id_t> find_group_id(const std::string &name) const {
+        auto res = groupRegistry.find(name);
+        return res == groupRegistry.end() ? std::nullopt : std::make_optional(res->second);
+    }
+
+    /**
+     * Same as `get_id`, but returns nothing when there is no such person.
+     */
+    std::optional<person_id_t> find_person(const std::string &name) const {
+        auto res = registry.find(name);
+        return res == registry.end() ? std::nullopt : std::make_optional(res->second);
     }
 
     std::string const &get_canonical_person_name(const person_id_t id) const {
@@ -87,15 +123,67 @@ public:
     void add_group(model::Group group) {
         auto &g = create_group_record(group.name);
         for (std::string a : group.mapsTo) {
-            if (is_group(a))
-                for (person_id_t id : get_group_members(a))
-                    g.insert(id);
-            else
-                g.insert(get_id(a));
+            if (is_group(a)) {
+                auto const &members = get_group_members(a);
+                if (&members != &g)
+                    g.insert(g.end(), members.begin(), members.end());
+            } else {
+                g.push_back(get_id(a));
+            }
         }
+
+        // group is a set, membership is frozen from now on
+        std::sort(g.begin(), g.end());
+        g.erase(std::unique(g.begin(), g.end()), g.end());
     }
 
     person_id_t get_id(std::string &name) const {
         return registry.at(name);
     }
-};
\ No newline at end of file
+};
+
+/**
+ * Reusable scratch space for deduplicating people. A person is marked as present by stamping their slot with
+ * the current epoch, so starting a new set is O(1) and nothing gets allocated once the buffers are large enough.
+ */
+class PeopleScratch {
+private:
+    std::vector<std::uint32_t> stamps;
+    std::uint32_t epoch = 0;
+
+public:
+    std::vector<person_id_t> payees;
+    std::vector<person_id_t> receivers;
+
+    PeopleScratch() = default;
+
+    PeopleScratch(PeopleScratch &other) = delete;
+
+    PeopleScratch(PeopleScratch &&old) = default;
+
+    PeopleScratch &operator=(PeopleScratch &&old) = default;
+
+    /**
+     * Start a new set, forgetting all the people marked before.
+     * @param numberOfPeople upper bound of the ids which will be marked
+     */
+    void next_epoch(usize numberOfPeople) {
+        if (stamps.size() < numberOfPeople)
+            stamps.resize(numberOfPeople, 0);
+        if (++epoch == 0) {
+            // overflow, the old stamps could collide with the new ones
+            std::fill(stamps.begin(), stamps.end(), 0);
+            epoch = 1;
+        }
+    }
+
+    /**
+     * @return true, when the person was not marked in the current epoch before
+     */
+    bool mark(person_id_t id) {
+        if (stamps[id] == epoch)
+            return false;
+        stamps[id] = epoch;
+        return true;
+    }
+};
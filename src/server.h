@@ -0,0 +1,415 @@
+#pragma once
+
+#include "types.h"
+#include "balancer.h"
+#include "parser.h"
+#include "simplifier.h"
+#include "writer.h"
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <map>
+#include <optional>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/**
+ * Keeps the balances of a ledger in memory and answers requests over a Unix domain socket, so that the ledger is not
+ * read again for every query. Every request is a single line, the protocol is:
+ *
+ *      add <ledger line>       append a line in the input format, answers `ok` or `error <reason>`
+ *      settle [currency]       simplified transactions of all currencies or of a single one in the output format,
+ *                              sorted by currency, followed by a line `end`
+ *      quit                    close the connection
+ *      shutdown                answer `ok` and stop the server
+ *
+ * Simplified transactions of every currency are cached until a new line changes its balances. Settlement only
+ * finishes the work deferred since the last one, so lines can be added after it.
+ *
+ * Invalid lines are refused before they touch the balances, because a line applied only halfway would leave them
+ * inconsistent.
+ *
+ * Client sockets are non-blocking. Answers are queued per client and sent when the socket is writable, so a client
+ * which stops reading a large answer does not stall the others. Its further requests are not read until most of the
+ * queue is sent.
+ */
+class LedgerServer {
+private:
+    // longest accepted request, longer ones close the connection
+    constexpr static usize MAX_REQUEST_LENGTH = 1 << 20;
+    // requests of a client are not read while more of its answers wait to be sent
+    constexpr static usize MAX_QUEUED_OUTPUT = 1 << 20;
+    constexpr static usize READ_SIZE = 1 << 12;
+
+    struct Client {
+        int fd;
+        // received data without a complete line yet
+        std::string input;
+        // answers not sent yet, starting at `sent`
+        std::string output;
+        usize sent = 0;
+        // no more requests are read, the connection is closed once the answers are sent
+        bool closing = false;
+
+        explicit Client(int fd) : fd{fd}, input{}, output{} {}
+
+        bool has_output() const {
+            return sent < output.size();
+        }
+    };
+
+    enum class Reply {
+        keep, close, stop
+    };
+
+    BalancingState state;
+    // all currencies ever defined, conversions remove them from the state during settlement
+    std::set<std::string> definedCurrencies;
+    // currency -> its simplified transactions, missing when its balances changed since they were computed
+    std::map<std::string, std::vector<SimpleTransaction>> settled;
+
+    std::string path;
+    int listener = -1;
+
+    bool is_name(std::string const &name) const {
+        return state.people.find_person(name) || state.people.find_group(name);
+    }
+
+    /**
+     * Check everything that would throw or abort in the middle of `advance_state`.
+     * @return reason why the element can't be applied, nothing when it can
+     */
+    std::optional<std::string> validate(model::ConfigElement const &element) {
+        return std::visit(overloaded {
+                [this](model::Person const &p) -> std::optional<std::string> {
+                    std::set<std::string> names(p.aliases.begin(), p.aliases.end());
+                    names.insert(p.name);
+                    if (names.size() != p.aliases.size() + 1)
+                        return "person \"" + p.name + "\" has duplicate names";
+                    for (auto const &name : names)
+                        if (state.people.find_person(name))
+                            return "person \"" + name + "\" is already defined";
+                    return std::nullopt;
+                },
+                [this](model::Group const &g) -> std::optional<std::string> {
+                    if (state.people.find_group(g.name))
+                        return "group \"" + g.name + "\" is already defined";
+                    for (auto const &member : g.mapsTo)
+                        if (!is_name(member))
+                            return "no group or person with name \"" + member + "\" exists";
+                    return std::nullopt;
+                },
+                [this](model::Currency const &c) -> std::optional<std::string> {
+                    if (definedCurrencies.count(c.name))
+                        return "currency \"" + c.name + "\" is already defined";
+                    return std::nullopt;
+                },
+                [this](model::Transaction const &t) -> std::optional<std::string> {
+                    if (t.paidBy.empty() || t.paidFor.empty())
+                        return std::string("transaction needs somebody paying and somebody paid for");
+                    for (auto const *names : {&t.paidBy, &t.paidFor})
+                        for (auto const &name : *names)
+                            if (!is_name(name))
+                                return "no group or person with name \"" + name + "\" exists";
+                    if (!state.currencies.count(state.conversions.resolve(t.value.second).second) &&
+                        !state.currencies.count(t.value.second))
+                        return "currency \"" + t.value.second + "\" is not defined";
+                    return std::nullopt;
+                },
+                [this](model::CurrencyTransformation const &c) -> std::optional<std::string> {
+                    auto const &source = c.first.second.name;
+                    auto const &target = c.second.second.name;
+                    if (state.conversions.is_converted(source))
+                        return "currency \"" + source + "\" is already converted";
+                    if (source == target)
+                        return "currency \"" + source + "\" can't be converted into itself";
+                    // closing a cycle moves the balances of the chain into the source, which becomes its root
+                    auto root = state.conversions.closes_cycle(source, target)
+                                ? source : state.conversions.resolve(target).second;
+                    // settlement would fail otherwise
+                    if (!definedCurrencies.count(root))
+                        return "currency \"" + root + "\" is not defined";
+                    return std::nullopt;
+                }
+        }, element);
+    }
+
+    /**
+     * Forget cached settlements which the element changes.
+     */
+    void invalidate(model::ConfigElement const &element) {
+        if (auto transaction = std::get_if<model::Transaction>(&element))
+            settled.erase(state.conversions.resolve(transaction->value.second).second);
+        else if (std::holds_alternative<model::CurrencyTransformation>(element))
+            settled.clear();
+    }
+
+    void add(std::string_view line, OutputWriter &out) {
+        auto tokens = token_splitter(line);
+        if (tokens.empty() || tokens.front()[0] == '#') {
+            out << "ok\n";
+            return;
+        }
+
+        std::optional<model::ConfigElement> element;
+        try {
+            element.emplace(line_parser(std::move(tokens)));
+        } catch (std::exception const &e) {
+            out << "error " << e.what() << '\n';
+            return;
+        }
+
+        if (auto error = validate(*element)) {
+            out << "error " << *error << '\n';
+            return;
+        }
+        invalidate(*element);
+        bool definesCurrencies = std::holds_alternative<model::Currency>(*element) ||
+                                 std::holds_alternative<model::CurrencyTransformation>(*element);
+        try {
+            advance_state(std::move(*element), state);
+        } catch (std::exception const &e) {
+            // `validate` should refuse everything that fails here, but one bad line must not stop the server
+            settled.clear();
+            out << "error " << e.what() << '\n';
+            return;
+        }
+        // currencies of a chain closed into a cycle get balances of their own
+        if (definesCurrencies)
+            for (auto const &currency : state.currencies)
+                definedCurrencies.insert(currency.first);
+        out << "ok\n";
+    }
+
+    std::vector<SimpleTransaction> const &settlement_of(std::string const &currency, DebtVector const &debts) {
+        auto cached = settled.find(currency);
+        if (cached != settled.end())
+            return cached->second;
+
+        auto[ids, debtVector] = debts.nonzero();
+        auto &transactions = settled[currency];
+        SimplifiedTransactionGenerator::create(std::move(ids), std::move(debtVector))
+                .into([&transactions](SimpleTransaction st) { transactions.push_back(st); });
+        return transactions;
+    }
+
+    void settle_currencies(std::string_view only, OutputWriter &out) {
+        try {
+            settle(state);
+        } catch (std::exception const &e) {
+            // possible only with an invalid ledger loaded at the start
+            out << "error " << e.what() << '\n';
+            return;
+        }
+
+        std::vector<std::string const *> currencies;
+        for (auto const &[currency, debts] : state.currencies)
+            if (only.empty() || currency == only)
+                currencies.push_back(&currency);
+        // converted currencies have no balances of their own, they are in the currency they were converted to
+        if (!only.empty() && !definedCurrencies.count(std::string(only))) {
+            out << "error currency \"" << only << "\" is not defined\n";
+            return;
+        }
+        std::sort(currencies.begin(), currencies.end(), [](auto a, auto b) { return *a < *b; });
+
+        for (auto const *currency : currencies)
+            for (auto const &st : settlement_of(*currency, state.currencies.at(*currency)))
+                st.write_to(out, state.people, *currency);
+        out << "end\n";
+    }
+
+    Reply handle(std::string_view request, OutputWriter &out) {
+        auto space = request.find(' ');
+        auto command = request.substr(0, space);
+        auto argument = space == std::string_view::npos ? std::string_view() : request.substr(space + 1);
+        while (!argument.empty() && isspace((unsigned char) argument.front()))
+            argument.remove_prefix(1);
+        while (!argument.empty() && isspace((unsigned char) argument.back()))
+            argument.remove_suffix(1);
+
+        if (command == "add") {
+            add(argument, out);
+        } else if (command == "settle") {
+            settle_currencies(argument, out);
+        } else if (command == "quit") {
+            return Reply::close;
+        } else if (command == "shutdown") {
+            out << "ok\n";
+            return Reply::stop;
+        } else {
+            out << "error unknown command \"" << command << "\"\n";
+        }
+        return Reply::keep;
+    }
+
+    /**
+     * Queue answers to all complete requests received from the client.
+     */
+    Reply answer(Client &client) {
+        OutputWriter out(client.output, READ_SIZE);
+        Reply reply = Reply::keep;
+        usize start = 0;
+        for (usize end; reply == Reply::keep && (end = client.input.find('\n', start)) != std::string::npos;
+             start = end + 1) {
+            std::string_view request(client.input.data() + start, end - start);
+            if (!request.empty() && request.back() == '\r')
+                request.remove_suffix(1);
+            reply = handle(request, out);
+        }
+        client.input.erase(0, start);
+        out.flush();
+
+        if (client.input.size() > MAX_REQUEST_LENGTH)
+            return Reply::close;
+        return reply;
+    }
+
+    /**
+     * Read what the client sent and queue the answers.
+     */
+    Reply receive(Client &client, char *buffer) {
+        isize received = read(client.fd, buffer, READ_SIZE);
+        if (received < 0 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK))
+            return Reply::keep;
+        if (received <= 0)
+            return Reply::close;
+        client.input.append(buffer, received);
+        return answer(client);
+    }
+
+    /**
+     * Send as much of the queued answers as the socket accepts without blocking.
+     * @return false when the connection is broken
+     */
+    static bool send_queued(Client &client) {
+        while (client.has_output()) {
+            isize written = write(client.fd, client.output.data() + client.sent, client.output.size() - client.sent);
+            if (written < 0) {
+                if (errno == EINTR)
+                    continue;
+                return errno == EAGAIN || errno == EWOULDBLOCK;
+            }
+            client.sent += written;
+        }
+        client.output.clear();
+        client.sent = 0;
+        return true;
+    }
+
+    /**
+     * Send all the queued answers, waiting for the client to read them.
+     */
+    static void send_all(Client &client) {
+        fcntl(client.fd, F_SETFL, fcntl(client.fd, F_GETFL) & ~O_NONBLOCK);
+        send_queued(client);
+    }
+
+public:
+    explicit LedgerServer(BalancingState &&state) : state{std::move(state)} {
+        for (auto const &currency : this->state.currencies)
+            definedCurrencies.insert(currency.first);
+    }
+
+    LedgerServer(LedgerServer &other) = delete;
+
+    ~LedgerServer() {
+        if (listener >= 0) {
+            close(listener);
+            unlink(path.c_str());
+        }
+    }
+
+    /**
+     * Create the socket, it's removed again by the destructor.
+     */
+    void listen(std::string socketPath) {
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        if (socketPath.size() >= sizeof(address.sun_path))
+            throw std::runtime_error("Socket path \"" + socketPath + "\" is too long");
+        std::memcpy(address.sun_path, socketPath.c_str(), socketPath.size() + 1);
+
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0)
+            throw std::runtime_error(std::string("Failed to create a socket: ") + std::strerror(errno));
+        if (bind(fd, (sockaddr *) &address, sizeof(address)) < 0 || ::listen(fd, SOMAXCONN) < 0) {
+            int error = errno;
+            close(fd);
+            throw std::runtime_error("Failed to listen on \"" + socketPath + "\": " + std::strerror(error));
+        }
+        listener = fd;
+        path = std::move(socketPath);
+    }
+
+    /**
+     * Answer requests of all the connected clients until one of them asks for shutdown.
+     */
+    void serve() {
+        // a client disconnecting before reading its answer must not kill the server
+        std::signal(SIGPIPE, SIG_IGN);
+
+        std::vector<Client> clients;
+        std::vector<pollfd> polled;
+        char buffer[READ_SIZE];
+        for (bool running = true; running;) {
+            polled.clear();
+            polled.push_back({listener, POLLIN, 0});
+            for (auto const &client : clients) {
+                short events = client.has_output() ? POLLOUT : 0;
+                if (!client.closing && client.output.size() - client.sent < MAX_QUEUED_OUTPUT)
+                    events |= POLLIN;
+                polled.push_back({client.fd, events, 0});
+            }
+
+            if (poll(polled.data(), polled.size(), -1) < 0) {
+                if (errno == EINTR)
+                    continue;
+                throw std::runtime_error(std::string("Failed to wait for requests: ") + std::strerror(errno));
+            }
+
+            // clients are checked in the order of `polled`, new ones are added only after that
+            std::vector<Client> kept;
+            for (usize i = 0; i < clients.size(); i++) {
+                auto &client = clients[i];
+                auto revents = polled[i + 1].revents;
+                if ((revents & polled[i + 1].events & POLLIN) || ((revents & (POLLHUP | POLLERR)) && !client.closing)) {
+                    Reply reply = receive(client, buffer);
+                    if (reply == Reply::stop) {
+                        // the client asking for the shutdown gets its answer
+                        send_all(client);
+                        running = false;
+                    }
+                    client.closing = client.closing || reply != Reply::keep;
+                }
+
+                bool connected = revents == 0 || send_queued(client);
+                if (connected && !(client.closing && !client.has_output()))
+                    kept.push_back(std::move(client));
+                else
+                    close(client.fd);
+            }
+            clients = std::move(kept);
+
+            if (polled[0].revents & POLLIN) {
+                int fd = accept(listener, nullptr, nullptr);
+                if (fd >= 0) {
+                    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+                    clients.emplace_back(fd);
+                }
+            }
+        }
+
+        for (auto const &client : clients)
+            close(client.fd);
+    }
+};
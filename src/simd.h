@@ -0,0 +1,204 @@
+#pragma once
+
+#include "types.h"
+#include <utility>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define FINANCNIDLO_SIMD_X86
+
+#include <immintrin.h>
+
+#endif
+
+/**
+ * Reductions over continuous blocks of numbers. The `double` versions use SSE2 or AVX2 vector instructions on x86-64,
+ * AVX2 is selected at runtime when the CPU supports it. Everything else, and every other architecture, uses plain
+ * loops and relies on the compiler.
+ *
+ * Vectorized sums add the values in a different order, so the result can differ in the last bits from the sequential
+ * sum. Minima and maxima are exact, indexes always point to the first occurrence. NaNs are not supported.
+ */
+namespace simd {
+    namespace detail {
+        inline usize find_scalar(const double *data, usize n, usize from, double value) {
+            for (usize i = from; i < n; i++)
+                if (data[i] == value)
+                    return i;
+            return n;
+        }
+
+#ifdef FINANCNIDLO_SIMD_X86
+        inline bool has_avx2() {
+            static const bool supported = __builtin_cpu_supports("avx2");
+            return supported;
+        }
+
+        __attribute__((target("avx2")))
+        inline double sum_avx2(const double *data, usize n) {
+            __m256d acc1 = _mm256_setzero_pd();
+            __m256d acc2 = _mm256_setzero_pd();
+            usize i = 0;
+            for (; i + 8 <= n; i += 8) {
+                acc1 = _mm256_add_pd(acc1, _mm256_loadu_pd(data + i));
+                acc2 = _mm256_add_pd(acc2, _mm256_loadu_pd(data + i + 4));
+            }
+            alignas(32) double lanes[4];
+            _mm256_store_pd(lanes, _mm256_add_pd(acc1, acc2));
+            double result = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+            for (; i < n; i++)
+                result += data[i];
+            return result;
+        }
+
+        inline double sum_sse2(const double *data, usize n) {
+            __m128d acc1 = _mm_setzero_pd();
+            __m128d acc2 = _mm_setzero_pd();
+            usize i = 0;
+            for (; i + 4 <= n; i += 4) {
+                acc1 = _mm_add_pd(acc1, _mm_loadu_pd(data + i));
+                acc2 = _mm_add_pd(acc2, _mm_loadu_pd(data + i + 2));
+            }
+            alignas(16) double lanes[2];
+            _mm_store_pd(lanes, _mm_add_pd(acc1, acc2));
+            double result = lanes[0] + lanes[1];
+            for (; i < n; i++)
+                result += data[i];
+            return result;
+        }
+
+        __attribute__((target("avx2")))
+        inline std::pair<double, double> minmax_avx2(const double *data, usize n) {
+            __m256d lo = _mm256_set1_pd(data[0]);
+            __m256d hi = lo;
+            usize i = 0;
+            for (; i + 4 <= n; i += 4) {
+                __m256d v = _mm256_loadu_pd(data + i);
+                lo = _mm256_min_pd(lo, v);
+                hi = _mm256_max_pd(hi, v);
+            }
+            alignas(32) double los[4], his[4];
+            _mm256_store_pd(los, lo);
+            _mm256_store_pd(his, hi);
+            double min = los[0], max = his[0];
+            for (usize j = 1; j < 4; j++) {
+                min = los[j] < min ? los[j] : min;
+                max = his[j] > max ? his[j] : max;
+            }
+            for (; i < n; i++) {
+                min = data[i] < min ? data[i] : min;
+                max = data[i] > max ? data[i] : max;
+            }
+            return std::make_pair(min, max);
+        }
+
+        inline std::pair<double, double> minmax_sse2(const double *data, usize n) {
+            __m128d lo = _mm_set1_pd(data[0]);
+            __m128d hi = lo;
+            usize i = 0;
+            for (; i + 2 <= n; i += 2) {
+                __m128d v = _mm_loadu_pd(data + i);
+                lo = _mm_min_pd(lo, v);
+                hi = _mm_max_pd(hi, v);
+            }
+            alignas(16) double los[2], his[2];
+            _mm_store_pd(los, lo);
+            _mm_store_pd(his, hi);
+            double min = los[1] < los[0] ? los[1] : los[0];
+            double max = his[1] > his[0] ? his[1] : his[0];
+            for (; i < n; i++) {
+                min = data[i] < min ? data[i] : min;
+                max = data[i] > max ? data[i] : max;
+            }
+            return std::make_pair(min, max);
+        }
+
+        __attribute__((target("avx2")))
+        inline usize find_avx2(const double *data, usize n, double value) {
+            const __m256d needle = _mm256_set1_pd(value);
+            usize i = 0;
+            for (; i + 4 <= n; i += 4) {
+                int mask = _mm256_movemask_pd(_mm256_cmp_pd(_mm256_loadu_pd(data + i), needle, _CMP_EQ_OQ));
+                if (mask != 0)
+                    return i + __builtin_ctz(mask);
+            }
+            return find_scalar(data, n, i, value);
+        }
+
+        inline usize find_sse2(const double *data, usize n, double value) {
+            const __m128d needle = _mm_set1_pd(value);
+            usize i = 0;
+            for (; i + 2 <= n; i += 2) {
+                int mask = _mm_movemask_pd(_mm_cmpeq_pd(_mm_loadu_pd(data + i), needle));
+                if (mask != 0)
+                    return i + __builtin_ctz(mask);
+            }
+            return find_scalar(data, n, i, value);
+        }
+#endif
+
+        /**
+         * @return index of the first value equal to the supplied one, `n` when there is none
+         */
+        inline usize find(const double *data, usize n, double value) {
+#ifdef FINANCNIDLO_SIMD_X86
+            return has_avx2() ? find_avx2(data, n, value) : find_sse2(data, n, value);
+#else
+            return find_scalar(data, n, 0, value);
+#endif
+        }
+    }
+
+    template<typename T>
+    T sum(const T *data, usize n) {
+        T result{};
+        for (usize i = 0; i < n; i++)
+            result += data[i];
+        return result;
+    }
+
+    inline double sum(const double *data, usize n) {
+#ifdef FINANCNIDLO_SIMD_X86
+        return detail::has_avx2() ? detail::sum_avx2(data, n) : detail::sum_sse2(data, n);
+#else
+        return sum<double>(data, n);
+#endif
+    }
+
+    /**
+     * @return indexes of the first minimal and the first maximal value, `n` must not be zero
+     */
+    template<typename T>
+    std::pair<usize, usize> argminmax(const T *data, usize n) {
+        usize min = 0, max = 0;
+        for (usize i = 1; i < n; i++) {
+            if (data[i] < data[min]) min = i;
+            if (data[i] > data[max]) max = i;
+        }
+        return std::make_pair(min, max);
+    }
+
+    inline std::pair<usize, usize> argminmax(const double *data, usize n) {
+#ifdef FINANCNIDLO_SIMD_X86
+        auto[min, max] = detail::has_avx2() ? detail::minmax_avx2(data, n) : detail::minmax_sse2(data, n);
+        return std::make_pair(detail::find(data, n, min), detail::find(data, n, max));
+#else
+        return argminmax<double>(data, n);
+#endif
+    }
+
+    /**
+     * @return index of the first minimal value, `n` must not be zero
+     */
+    template<typename T>
+    usize argmin(const T *data, usize n) {
+        return argminmax(data, n).first;
+    }
+
+    /**
+     * @return index of the first maximal value, `n` must not be zero
+     */
+    template<typename T>
+    usize argmax(const T *data, usize n) {
+        return argminmax(data, n).second;
+    }
+}
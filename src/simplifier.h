@@ -5,6 +5,7 @@
 #include "model.h"
 #include "balancer.h"
 #include "people.h"
+#include "writer.h"
 #include <limits.h>
 #include <float.h>
 #include <vector>
@@ -22,22 +23,35 @@ struct SimpleTransaction {
                                   std::pair{amount, std::move(currency)},
                                   std::vector{idRegister.get_canonical_person_name(paidTo)});
     }
+
+    /**
+     * Write the transaction in the same format as `model::Transaction` without building it first.
+     */
+    void write_to(OutputWriter &out, IDRegister const &idRegister, std::string const &currency) const {
+        out << idRegister.get_canonical_person_name(paidBy) << " paid " << amount << currency << " for "
+            << idRegister.get_canonical_person_name(paidTo) << '\n';
+    }
 };
 
 /**
  * When supplied with debt vector, it provides an iterator for transactions representing that debt vector. Number of
  * them should be minimal.
  *
+ * The generator works only with people whose balance is not zero. It gets their ids and their balances in two
+ * vectors of the same length.
+ *
  * This generator knows only about the numbers, it has no idea about currencies and people, who hold the debt.
  * That means, that the simplified transaction has to be converted to full transaction before other usage.
  */
 class SimplifiedTransactionGenerator {
 private:
+    std::vector<person_id_t> ids;
     std::vector<double> debtVector;
 
-    SimplifiedTransactionGenerator(std::vector<double> &&debtVector) : debtVector(std::move(debtVector)) {
-        if (this->debtVector.size() < 2) {
-            throw std::logic_error("Does not make sense to generate transactions for so few people!");
+    SimplifiedTransactionGenerator(std::vector<person_id_t> &&ids, std::vector<double> &&debtVector)
+            : ids(std::move(ids)), debtVector(std::move(debtVector)) {
+        if (this->ids.size() != this->debtVector.size()) {
+            throw std::logic_error("Every balance must belong to exactly one person!");
         }
     }
 
@@ -47,17 +61,21 @@ public:
     SimplifiedTransactionGenerator(SimplifiedTransactionGenerator &other) = delete;
 
     SimplifiedTransactionGenerator(SimplifiedTransactionGenerator &&old) {
+        std::swap(this->ids, old.ids);
         std::swap(this->debtVector, old.debtVector);
     }
 
     std::optional<SimpleTransaction> next() {
         // check if we should do something
-        if (Iter::from(debtVector).map([](auto d) { return std::abs(d); }).max() < 0.001)
+        if (debtVector.size() < 2)
             return std::nullopt;
 
         // greedy algo, take the maximal debtor and maximal loaner and create a transaction between them
-        auto[loaner, loan] = *(Iter::from(debtVector).enumerate().max_by([](auto p) { return p.second; }));
-        auto[debtor, debt] = *(Iter::from(debtVector).enumerate().min_by([](auto p) { return p.second; }));
+        auto[minimum, maximum] = *Iter::from(debtVector).argminmax();
+        auto[debtor, debt] = minimum;
+        auto[loaner, loan] = maximum;
+        if (std::max(-debt, loan) < 0.001)
+            return std::nullopt;
 
         double transactionVal = std::min(-debt, loan);
 
@@ -67,14 +85,14 @@ public:
 
         // save new transaction
         SimpleTransaction trans;
-        trans.paidBy = debtor;
+        trans.paidBy = ids[debtor];
         trans.amount = transactionVal;
-        trans.paidTo = loaner;
+        trans.paidTo = ids[loaner];
 
         return trans;
     }
 
-    static I<SimplifiedTransactionGenerator> create(std::vector<double> &&debtVector) {
-        return I(SimplifiedTransactionGenerator(std::move(debtVector)));
+    static I<SimplifiedTransactionGenerator> create(std::vector<person_id_t> &&ids, std::vector<double> &&debtVector) {
+        return I(SimplifiedTransactionGenerator(std::move(ids), std::move(debtVector)));
     }
 };
@@ -0,0 +1,263 @@
+#pragma once
+
+#include "types.h"
+#include "model.h"
+#include "people.h"
+#include "iterator.h"
+#include <atomic>
+#include <chrono>
+#include <ctime>
+#include <map>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <variant>
+
+/**
+ * Measures wall time and CPU time of the process from the moment the stopwatch is created.
+ */
+class Stopwatch {
+private:
+    std::chrono::steady_clock::time_point wallStart;
+    std::clock_t cpuStart;
+public:
+    Stopwatch() : wallStart{std::chrono::steady_clock::now()}, cpuStart{std::clock()} {}
+
+    double wall_seconds() const {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+    }
+
+    /**
+     * @return CPU time of all threads of the process
+     */
+    double cpu_seconds() const {
+        return (double) (std::clock() - cpuStart) / CLOCKS_PER_SEC;
+    }
+};
+
+/**
+ * Time spent inside of a single stage of the pipeline. Stages run interleaved, some of them on multiple threads, so
+ * only the time inside of the stage function is counted. Every call runs on a single thread, so its CPU time is
+ * the CPU time of that thread.
+ */
+struct StageStats {
+    struct Start {
+        std::chrono::steady_clock::time_point wall;
+        u64 cpu;
+    };
+
+    std::atomic<u64> calls{0};
+    std::atomic<u64> nanoseconds{0};
+    std::atomic<u64> cpuNanoseconds{0};
+
+    static u64 thread_cpu_nanoseconds() {
+        timespec now{};
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+        return (u64) now.tv_sec * 1000000000 + (u64) now.tv_nsec;
+    }
+
+    static Start start() {
+        return {std::chrono::steady_clock::now(), thread_cpu_nanoseconds()};
+    }
+
+    void add(Start start) {
+        calls.fetch_add(1, std::memory_order_relaxed);
+        nanoseconds.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - start.wall).count(), std::memory_order_relaxed);
+        cpuNanoseconds.fetch_add(thread_cpu_nanoseconds() - start.cpu, std::memory_order_relaxed);
+    }
+
+    double seconds() const {
+        return (double) nanoseconds / 1e9;
+    }
+
+    double cpu_seconds() const {
+        return (double) cpuNanoseconds / 1e9;
+    }
+};
+
+/**
+ * Statistics of a single run, written to stderr with `--stats`. Everything is collected only by the instrumented
+ * version of the pipeline, see `timed` and `observe`.
+ */
+struct PipelineStats {
+    Stopwatch total;
+
+    // reading the input
+    u64 lines = 0;
+    u64 bytes = 0;
+    double ingestWall = 0.;
+    double ingestCpu = 0.;
+
+    StageStats reading;
+    StageStats tokenize;
+    StageStats parse;
+    StageStats balance;
+
+    // number of config elements of every kind, indexed same as `model::ConfigElement`
+    u64 elements[std::variant_size_v<model::ConfigElement>] = {};
+
+    // names of groups in transactions and their sizes
+    u64 groupExpansions = 0;
+    u64 groupMembers = 0;
+    u64 largestGroup = 0;
+
+    double settleWall = 0.;
+    double settleCpu = 0.;
+
+    // currency -> (people with non-zero balance, number of simplified transactions)
+    std::map<std::string, std::pair<u64, u64>> simplified;
+    double simplifyWall = 0.;
+    double simplifyCpu = 0.;
+
+    void read(std::string_view line) {
+        lines++;
+        bytes += line.size() + 1;
+    }
+
+    /**
+     * Count the config element and sizes of the groups it is going to be split between.
+     */
+    void record(model::ConfigElement const &element, IDRegister const &people) {
+        elements[element.index()]++;
+        if (auto transaction = std::get_if<model::Transaction>(&element)) {
+            for (auto const *names : {&transaction->paidBy, &transaction->paidFor}) {
+                for (auto const &name : *names) {
+                    if (auto members = people.find_group(name)) {
+                        groupExpansions++;
+                        groupMembers += members->size();
+                        largestGroup = std::max(largestGroup, (u64) members->size());
+                    }
+                }
+            }
+        }
+    }
+
+    void write_json(std::ostream &out) const {
+        auto const stage = [&out](const char *name, StageStats const &s) {
+            out << "\"" << name << "\":{\"calls\":" << s.calls << ",\"busy_seconds\":" << s.seconds()
+                << ",\"cpu_seconds\":" << s.cpu_seconds() << "}";
+        };
+        auto const rate = [](double amount, double seconds) { return seconds > 0. ? amount / seconds : 0.; };
+
+        out << "{\"ingest\":{\"lines\":" << lines << ",\"bytes\":" << bytes
+            << ",\"wall_seconds\":" << ingestWall << ",\"cpu_seconds\":" << ingestCpu
+            << ",\"lines_per_second\":" << rate(lines, ingestWall)
+            << ",\"bytes_per_second\":" << rate(bytes, ingestWall) << "},";
+
+        out << "\"stages\":{";
+        stage("read", reading);
+        out << ",";
+        stage("tokenize", tokenize);
+        out << ",";
+        stage("parse", parse);
+        out << ",";
+        stage("balance", balance);
+        out << "},";
+
+        const char *kinds[] = {"person", "group", "currency", "transaction", "conversion"};
+        static_assert(std::size(kinds) == std::variant_size_v<model::ConfigElement>);
+        out << "\"elements\":{";
+        for (usize i = 0; i < std::size(kinds); i++)
+            out << (i == 0 ? "" : ",") << "\"" << kinds[i] << "\":" << elements[i];
+        out << "},";
+
+        out << "\"group_expansions\":{\"count\":" << groupExpansions << ",\"members\":" << groupMembers
+            << ",\"largest\":" << largestGroup << "},";
+
+        out << "\"settle\":{\"wall_seconds\":" << settleWall << ",\"cpu_seconds\":" << settleCpu << "},";
+
+        out << "\"simplify\":{\"wall_seconds\":" << simplifyWall << ",\"cpu_seconds\":" << simplifyCpu
+            << ",\"currencies\":{";
+        bool first = true;
+        for (auto const &[currency, counts] : simplified) {
+            out << (first ? "" : ",") << "\"";
+            for (char c : currency) {
+                if (c == '"' || c == '\\')
+                    out << '\\';
+                out << c;
+            }
+            out << "\":{\"people\":" << counts.first << ",\"transactions\":" << counts.second << "}";
+            first = false;
+        }
+        out << "}},";
+
+        out << "\"total\":{\"wall_seconds\":" << total.wall_seconds() << ",\"cpu_seconds\":" << total.cpu_seconds()
+            << "}}" << std::endl;
+    }
+};
+
+/**
+ * Measure the time spent in the function, when the statistics are enabled. Otherwise the function is returned as it
+ * is, so there is no overhead at all.
+ */
+template<bool enabled, typename Func>
+auto timed(StageStats &stage, Func f) {
+    if constexpr (!enabled) {
+        return f;
+    } else {
+        return [&stage, f](auto &&... args) {
+            auto start = StageStats::start();
+            if constexpr (std::is_void_v<decltype(f(std::forward<decltype(args)>(args)...))>) {
+                f(std::forward<decltype(args)>(args)...);
+                stage.add(start);
+            } else {
+                auto result = f(std::forward<decltype(args)>(args)...);
+                stage.add(start);
+                return result;
+            }
+        };
+    }
+}
+
+/**
+ * Source iterator whose `next()` calls are measured as a stage, see `timed_source`.
+ */
+template<typename Iter>
+class TimedSource {
+private:
+    Iter iter;
+    StageStats &stage;
+public:
+    using value_type = typename Iter::value_type;
+    constexpr static bool lending = is_lending<Iter>::value;
+
+    TimedSource(Iter &&iter, StageStats &stage) : iter{std::move(iter)}, stage{stage} {}
+
+    TimedSource(TimedSource const &other) = delete;
+
+    TimedSource(TimedSource &&old) = default;
+
+    std::optional<value_type> next() {
+        auto start = StageStats::start();
+        auto value = iter.next();
+        stage.add(start);
+        return value;
+    }
+};
+
+/**
+ * Measure the time spent reading values from the source iterator, when the statistics are enabled. Otherwise the
+ * iterator is returned as it is.
+ */
+template<bool enabled, typename Iter>
+auto timed_source(StageStats &stage, Iter &&iter) {
+    if constexpr (!enabled)
+        return std::move(iter);
+    else
+        return TimedSource<Iter>(std::move(iter), stage);
+}
+
+/**
+ * Run the function only when the statistics are enabled.
+ */
+template<bool enabled, typename Func>
+auto observe(Func f) {
+    return [f](auto const &value) {
+        if constexpr (enabled)
+            f(value);
+    };
+}
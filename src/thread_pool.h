@@ -0,0 +1,120 @@
+#pragma once
+
+#include "types.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <algorithm>
+
+/**
+ * Fixed size pool of worker threads. Every worker has its own queue of tasks, new tasks are distributed between the
+ * queues in round robin fashion. A worker takes tasks from the front of its own queue, so the oldest tasks finish
+ * first. When it runs out of them, it steals from the back of the queues of the other workers.
+ *
+ * The destructor waits for all already submitted tasks to finish.
+ */
+class ThreadPool {
+private:
+    struct Queue {
+        std::mutex lock;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> workers;
+
+    std::mutex sleepLock;
+    std::condition_variable wakeUp;
+    std::atomic<usize> waitingTasks{0};
+    std::atomic<usize> nextQueue{0};
+    bool stopping = false;
+
+    bool take_own(usize me, std::function<void()> &task) {
+        auto &queue = *queues[me];
+        std::lock_guard guard(queue.lock);
+        if (queue.tasks.empty())
+            return false;
+        task = std::move(queue.tasks.front());
+        queue.tasks.pop_front();
+        return true;
+    }
+
+    bool steal(usize me, std::function<void()> &task) {
+        for (usize i = 1; i < queues.size(); i++) {
+            auto &queue = *queues[(me + i) % queues.size()];
+            std::lock_guard guard(queue.lock);
+            if (queue.tasks.empty())
+                continue;
+            task = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+            return true;
+        }
+        return false;
+    }
+
+    void run(usize me) {
+        std::function<void()> task;
+        while (true) {
+            if (take_own(me, task) || steal(me, task)) {
+                waitingTasks--;
+                task();
+                task = nullptr;
+                continue;
+            }
+
+            std::unique_lock guard(sleepLock);
+            wakeUp.wait(guard, [this]() { return stopping || waitingTasks > 0; });
+            if (stopping && waitingTasks == 0)
+                return;
+        }
+    }
+
+public:
+    /**
+     * @param threads number of worker threads, at least one is always started
+     */
+    explicit ThreadPool(usize threads) {
+        threads = std::max(threads, (usize) 1);
+        for (usize i = 0; i < threads; i++)
+            queues.push_back(std::make_unique<Queue>());
+        for (usize i = 0; i < threads; i++)
+            workers.emplace_back([this, i]() { run(i); });
+    }
+
+    ThreadPool(ThreadPool &other) = delete;
+
+    ThreadPool(ThreadPool &&old) = delete;
+
+    ~ThreadPool() {
+        {
+            std::lock_guard guard(sleepLock);
+            stopping = true;
+        }
+        wakeUp.notify_all();
+        for (auto &worker : workers)
+            worker.join();
+    }
+
+    usize size() const {
+        return workers.size();
+    }
+
+    void submit(std::function<void()> task) {
+        // counted before it's visible in the queue, so that the counter never underflows
+        {
+            std::lock_guard guard(sleepLock);
+            waitingTasks++;
+        }
+        auto &queue = *queues[nextQueue++ % queues.size()];
+        {
+            std::lock_guard guard(queue.lock);
+            queue.tasks.push_back(std::move(task));
+        }
+        wakeUp.notify_one();
+    }
+};
@@ -0,0 +1,220 @@
+#pragma once
+
+#include "types.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string_view>
+#include <vector>
+
+/**
+ * Spans of time written as Chrome trace events, which can be opened in `chrome://tracing` or in Perfetto.
+ *
+ * A `trace::Span` records the time between its construction and destruction. Every thread has its own ring buffer
+ * of spans, so recording does not need any locking. When the buffer is full, the oldest spans are overwritten.
+ * Tracing is off unless `trace::start()` is called, then a span costs only a check of a flag.
+ */
+namespace trace {
+
+    // spans kept by every thread, the older ones are overwritten
+    constexpr usize BUFFER_CAPACITY = 1 << 16;
+    constexpr usize DETAIL_LENGTH = 40;
+
+    struct Event {
+        const char *name;
+        i64 start;
+        i64 duration;
+        // optional description, e.g. name of a currency, it's cut to fit
+        char detail[DETAIL_LENGTH];
+        // optional number, e.g. number of lines in a chunk, negative when not set
+        i64 count;
+    };
+
+    struct Buffer {
+        usize thread;
+        std::vector<Event> events;
+        // number of all events recorded, the buffer keeps only the last `BUFFER_CAPACITY`
+        usize recorded = 0;
+
+        explicit Buffer(usize thread) : thread{thread} {
+            events.resize(BUFFER_CAPACITY);
+        }
+    };
+
+    struct Registry {
+        std::atomic<bool> enabled{false};
+        std::chrono::steady_clock::time_point origin = std::chrono::steady_clock::now();
+        std::mutex lock;
+        // buffers of all threads, kept also after the threads end
+        std::vector<std::shared_ptr<Buffer>> buffers;
+    };
+
+    inline Registry &registry() {
+        static Registry r;
+        return r;
+    }
+
+    inline bool enabled() {
+        return registry().enabled.load(std::memory_order_relaxed);
+    }
+
+    inline Buffer &thread_buffer();
+
+    /**
+     * Enable tracing. The calling thread is the first one in the trace.
+     */
+    inline void start() {
+        registry().origin = std::chrono::steady_clock::now();
+        registry().enabled = true;
+        thread_buffer();
+    }
+
+    /**
+     * Disable tracing. The spans recorded so far are kept until they are written.
+     */
+    inline void stop() {
+        registry().enabled = false;
+    }
+
+    inline i64 now() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - registry().origin).count();
+    }
+
+    inline Buffer &thread_buffer() {
+        thread_local std::shared_ptr<Buffer> buffer = [] {
+            auto &r = registry();
+            std::lock_guard guard(r.lock);
+            r.buffers.push_back(std::make_shared<Buffer>(r.buffers.size()));
+            return r.buffers.back();
+        }();
+        return *buffer;
+    }
+
+    /**
+     * Records the time from its construction to its destruction, when tracing is enabled.
+     */
+    class Span {
+    private:
+        const char *name;
+        i64 start;
+        i64 minDuration;
+        std::string_view detail;
+        i64 count = -1;
+
+    public:
+        /**
+         * @param name must live until the trace is written, use string literals
+         * @param minDuration shorter spans are not recorded, in nanoseconds
+         */
+        explicit Span(const char *name, i64 minDuration = 0)
+                : name{name}, start{enabled() ? now() : -1}, minDuration{minDuration} {}
+
+        Span(Span &other) = delete;
+
+        /**
+         * @param detail copied only when the span is recorded, so it must live until the end of the span
+         */
+        void set_detail(std::string_view d) {
+            detail = d;
+        }
+
+        void set_count(i64 c) {
+            count = c;
+        }
+
+        ~Span() {
+            if (start < 0)
+                return;
+            i64 duration = now() - start;
+            if (duration < minDuration)
+                return;
+
+            auto &buffer = thread_buffer();
+            auto &event = buffer.events[buffer.recorded++ % BUFFER_CAPACITY];
+            event.name = name;
+            event.start = start;
+            event.duration = duration;
+            usize length = std::min(detail.size(), DETAIL_LENGTH - 1);
+            if (length > 0)
+                std::memcpy(event.detail, detail.data(), length);
+            event.detail[length] = '\0';
+            event.count = count;
+        }
+    };
+
+    /**
+     * Hooks of `par_map` recording a span for reading and for mapping of every chunk, see `NoChunkHooks`.
+     */
+    struct ChunkSpans {
+        template<typename Read>
+        void on_read(Read &&read) {
+            Span span("read chunk");
+            span.set_count(read());
+        }
+
+        template<typename Map>
+        void on_map(usize size, Map &&map) {
+            Span span("map chunk");
+            span.set_count(size);
+            map();
+        }
+    };
+
+    namespace detail {
+        inline void write_string(std::ostream &out, const char *s) {
+            out << '"';
+            for (; *s != '\0'; s++) {
+                if (*s == '"' || *s == '\\')
+                    out << '\\' << *s;
+                else if ((unsigned char) *s < 0x20)
+                    out << ' ';
+                else
+                    out << *s;
+            }
+            out << '"';
+        }
+    }
+
+    /**
+     * Write all the recorded spans as Chrome trace-event JSON. Must be called only after the traced threads finished.
+     */
+    inline void write_chrome_json(std::ostream &out) {
+        auto &r = registry();
+        std::lock_guard guard(r.lock);
+        usize dropped = 0;
+        bool first = true;
+
+        out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+        for (auto const &buffer : r.buffers) {
+            out << (first ? "" : ",") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->thread
+                << ",\"args\":{\"name\":\"" << (buffer->thread == 0 ? "main" : "worker") << "\"}}";
+            first = false;
+
+            usize kept = std::min(buffer->recorded, BUFFER_CAPACITY);
+            dropped += buffer->recorded - kept;
+            for (usize i = buffer->recorded - kept; i < buffer->recorded; i++) {
+                auto const &event = buffer->events[i % BUFFER_CAPACITY];
+                out << ",{\"name\":";
+                detail::write_string(out, event.name);
+                out << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->thread
+                    << ",\"ts\":" << event.start / 1000 << '.' << event.start % 1000 / 100
+                    << ",\"dur\":" << event.duration / 1000 << '.' << event.duration % 1000 / 100 << ",\"args\":{";
+                bool firstArg = true;
+                if (event.detail[0] != '\0') {
+                    out << "\"detail\":";
+                    detail::write_string(out, event.detail);
+                    firstArg = false;
+                }
+                if (event.count >= 0)
+                    out << (firstArg ? "" : ",") << "\"count\":" << event.count;
+                out << "}}";
+            }
+        }
+        out << "],\"otherData\":{\"dropped_events\":" << dropped << "}}" << std::endl;
+    }
+}
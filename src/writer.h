@@ -0,0 +1,145 @@
+#pragma once
+
+#include "types.h"
+#include "alloc_tracker.h"
+#include <algorithm>
+#include <charconv>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unistd.h>
+
+/**
+ * Buffered output written directly to a file descriptor. Everything is collected in a single large buffer, which is
+ * written by `write(2)` only when it's full, on `flush()` and in the destructor. Unlike `std::cout << std::endl`, a line
+ * does not cost a system call. The output can also be appended to a string instead, e.g. to be sent later.
+ *
+ * Numbers are formatted with `std::to_chars`, with the same precision as the default of iostreams, so the output is
+ * byte for byte the same as before.
+ */
+class OutputWriter {
+private:
+    // significant digits of the written amounts, same as `std::cout` uses by default
+    constexpr static int AMOUNT_PRECISION = 6;
+    // longest formatted double in the general format with the precision above, e.g. "-1.23457e+308"
+    constexpr static usize MAX_NUMBER_LENGTH = 32;
+
+    int fd;
+    // when set, the output is appended to it instead of being written to `fd`
+    std::string *target = nullptr;
+    std::vector<char> buffer;
+    usize used = 0;
+
+    void write_all(const char *data, usize size) {
+        if (target) {
+            target->append(data, size);
+            return;
+        }
+        while (size > 0) {
+            isize written = ::write(fd, data, size);
+            if (written < 0) {
+                if (errno == EINTR)
+                    continue;
+                throw std::runtime_error(std::string("Failed to write the output: ") + std::strerror(errno));
+            }
+            data += written;
+            size -= written;
+        }
+    }
+
+public:
+    /**
+     * @param fd descriptor to write into, it's not closed at the end
+     * @param capacity size of the buffer in bytes
+     */
+    explicit OutputWriter(int fd = STDOUT_FILENO, usize capacity = 1 << 16)
+            : fd{fd} {
+        ALLOC_SCOPE(output);
+        buffer.resize(std::max(capacity, MAX_NUMBER_LENGTH));
+    }
+
+    /**
+     * @param target string to append the output to
+     * @param capacity size of the buffer in bytes
+     */
+    explicit OutputWriter(std::string &target, usize capacity = 1 << 12)
+            : fd{-1}, target{&target} {
+        ALLOC_SCOPE(output);
+        buffer.resize(std::max(capacity, MAX_NUMBER_LENGTH));
+    }
+
+    OutputWriter(OutputWriter &other) = delete;
+
+    OutputWriter(OutputWriter &&old) = delete;
+
+    ~OutputWriter() {
+        try {
+            flush();
+        } catch (std::runtime_error const &) {
+            // nobody to report it to, the output is lost anyway
+        }
+    }
+
+    void flush() {
+        write_all(buffer.data(), used);
+        used = 0;
+    }
+
+    OutputWriter &operator<<(std::string_view text) {
+        if (used + text.size() > buffer.size()) {
+            flush();
+            // too long to be buffered at all
+            if (text.size() > buffer.size()) {
+                write_all(text.data(), text.size());
+                return *this;
+            }
+        }
+        std::memcpy(buffer.data() + used, text.data(), text.size());
+        used += text.size();
+        return *this;
+    }
+
+    OutputWriter &operator<<(char c) {
+        if (used == buffer.size())
+            flush();
+        buffer[used++] = c;
+        return *this;
+    }
+
+    OutputWriter &operator<<(double value) {
+        if (used + MAX_NUMBER_LENGTH > buffer.size())
+            flush();
+        char *begin = buffer.data() + used;
+#ifdef __cpp_lib_to_chars
+        auto result = std::to_chars(begin, begin + MAX_NUMBER_LENGTH, value, std::chars_format::general,
+                                    AMOUNT_PRECISION);
+        used = result.ptr - buffer.data();
+#else
+        used += std::snprintf(begin, MAX_NUMBER_LENGTH, "%.*g", AMOUNT_PRECISION, value);
+#endif
+        return *this;
+    }
+};
+
+/**
+ * Run the function and flush the writer when it throws. The exception usually terminates the program without running
+ * the destructor of the writer, the output written before it would be lost.
+ * @return result of the function
+ */
+template<typename Func>
+auto flushed_on_error(OutputWriter &out, Func &&f) {
+    try {
+        return f();
+    } catch (...) {
+        try {
+            out.flush();
+        } catch (std::runtime_error const &) {
+            // the original error is more important
+        }
+        throw;
+    }
+}
@@ -0,0 +1,328 @@
+/**
+ * Generates random input for the simplifier. Same as `generate.py`, but fast and with more realistic profiles.
+ *
+ *      financnidlo-generate <profile> <people> <transactions> [seed]
+ *
+ * The output depends only on the arguments, the same seed always gives the same input.
+ */
+
+#include "types.h"
+#include "writer.h"
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace {
+
+    /**
+     * SplitMix64, small and fast generator with good enough randomness. Unlike the generators in `<random>`,
+     * the sequence is the same with every standard library.
+     */
+    class Random {
+    private:
+        std::uint64_t state;
+    public:
+        explicit Random(std::uint64_t seed) : state{seed} {}
+
+        std::uint64_t next() {
+            std::uint64_t z = (state += 0x9e3779b97f4a7c15);
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+            return z ^ (z >> 31);
+        }
+
+        /**
+         * @return number from `0` to `n - 1`
+         */
+        usize below(usize n) {
+            return next() % n;
+        }
+
+        bool chance(usize percent) {
+            return below(100) < percent;
+        }
+    };
+
+    /**
+     * Unique name of letters for every index lower than 26^length. The index is scrambled by an affine bijection,
+     * so the names look random.
+     */
+    std::string name_of(usize index, usize length = 12) {
+        std::uint64_t space = 1;
+        for (usize i = 0; i < length; i++)
+            space *= 26;
+        // the multiplier is coprime with 26, so different indexes give different names
+        std::uint64_t multiplier = (std::uint64_t) ((double) space * 0.6180339887) | 1;
+        if (multiplier % 13 == 0)
+            multiplier += 2;
+        std::uint64_t x = ((unsigned __int128) index * multiplier + space / 7) % space;
+        std::string name(length, 'a');
+        for (usize i = 0; i < length; i++) {
+            name[i] = (char) ('a' + x % 26);
+            x /= 26;
+        }
+        return name;
+    }
+
+    /**
+     * Writes the input and keeps track of the names.
+     */
+    struct Ledger {
+        OutputWriter &out;
+        Random random;
+        std::vector<std::string> people;
+        // all names usable in a transaction for the person with the same index
+        std::vector<std::vector<std::string>> aliases;
+        std::vector<std::string> currencies;
+        usize names = 0;
+
+        Ledger(OutputWriter &out, std::uint64_t seed) : out{out}, random{seed} {}
+
+        std::string const &define_person(usize numberOfAliases = 0) {
+            people.push_back(name_of(names++));
+            aliases.emplace_back();
+            out << "def person " << people.back();
+            for (usize i = 0; i < numberOfAliases; i++) {
+                aliases.back().push_back(name_of(names++));
+                out << ' ' << aliases.back().back();
+            }
+            out << '\n';
+            return people.back();
+        }
+
+        std::string define_group(std::vector<std::string> const &members) {
+            auto name = name_of(names++);
+            out << "def group " << name;
+            for (auto const &member : members)
+                out << ' ' << member;
+            out << '\n';
+            return name;
+        }
+
+        void define_currency() {
+            currencies.push_back(name_of(currencies.size(), 4));
+            out << "def currency " << currencies.back() << '\n';
+        }
+
+        std::string const &random_person() {
+            return people[random.below(people.size())];
+        }
+
+        double random_amount() {
+            return (double) random.below(100000) / 100 + 0.01;
+        }
+
+        std::string const &random_currency() {
+            return currencies[random.below(currencies.size())];
+        }
+
+        void transaction(std::vector<std::string> const &paidBy, std::string const &currency,
+                         std::vector<std::string> const &paidFor) {
+            for (usize i = 0; i < paidBy.size(); i++)
+                out << (i == 0 ? "" : " ") << paidBy[i];
+            out << " paid " << random_amount() << currency << " for";
+            for (auto const &name : paidFor)
+                out << ' ' << name;
+            out << '\n';
+        }
+    };
+
+    /**
+     * Same as `generate.py`, one currency and transactions between two random people.
+     */
+    void flat(Ledger &ledger, usize people, usize transactions) {
+        ledger.define_currency();
+        for (usize i = 0; i < people; i++)
+            ledger.define_person();
+        for (usize i = 0; i < transactions; i++)
+            ledger.transaction({ledger.random_person()}, ledger.currencies[0], {ledger.random_person()});
+    }
+
+    /**
+     * Mostly definitions, every person has aliases and the transactions count is the number of small groups defined.
+     */
+    void definitions(Ledger &ledger, usize people, usize transactions) {
+        for (usize i = 0; i < std::max(people / 1000, (usize) 1); i++)
+            ledger.define_currency();
+        for (usize i = 0; i < people; i++)
+            ledger.define_person(ledger.random.below(4));
+        for (usize i = 0; i < transactions; i++) {
+            std::vector<std::string> members;
+            for (usize j = 2 + ledger.random.below(6); j > 0; j--)
+                members.push_back(ledger.random_person());
+            ledger.define_group(members);
+        }
+        ledger.transaction({ledger.random_person()}, ledger.currencies[0], {ledger.random_person()});
+    }
+
+    /**
+     * Groups of eight people, groups of eight groups above them and so on. Transactions are paid for a group from
+     * a random level.
+     */
+    void nested_groups(Ledger &ledger, usize people, usize transactions) {
+        ledger.define_currency();
+        for (usize i = 0; i < people; i++)
+            ledger.define_person();
+
+        std::vector<std::string> groups;
+        std::vector<std::string> level = ledger.people;
+        while (level.size() > 1) {
+            std::vector<std::string> above;
+            for (usize i = 0; i < level.size(); i += 8) {
+                std::vector<std::string> members(level.begin() + i, level.begin() + std::min(i + 8, level.size()));
+                above.push_back(ledger.define_group(members));
+            }
+            groups.insert(groups.end(), above.begin(), above.end());
+            level = std::move(above);
+        }
+
+        for (usize i = 0; i < transactions; i++)
+            ledger.transaction({ledger.random_person()}, ledger.currencies[0], {groups[ledger.random.below(groups.size())]});
+    }
+
+    /**
+     * Half of the transactions is paid for everybody.
+     */
+    void big_groups(Ledger &ledger, usize people, usize transactions) {
+        ledger.define_currency();
+        for (usize i = 0; i < people; i++)
+            ledger.define_person();
+        auto all = ledger.define_group(ledger.people);
+
+        for (usize i = 0; i < transactions; i++) {
+            if (ledger.random.chance(50))
+                ledger.transaction({ledger.random_person()}, ledger.currencies[0], {all});
+            else
+                ledger.transaction({ledger.random_person()}, ledger.currencies[0], {ledger.random_person()});
+        }
+    }
+
+    /**
+     * Many currencies converted in chains of up to four currencies.
+     */
+    void currencies(Ledger &ledger, usize people, usize transactions) {
+        const usize numberOfCurrencies = std::max(people / 50, (usize) 8);
+        for (usize i = 0; i < numberOfCurrencies; i++)
+            ledger.define_currency();
+        for (usize i = 0; i < people; i++)
+            ledger.define_person();
+        for (usize i = 0; i < transactions; i++)
+            ledger.transaction({ledger.random_person()}, ledger.random_currency(), {ledger.random_person()});
+
+        // every fourth currency is a root, the ones before it are converted along the chain to it
+        for (usize i = 0; i < numberOfCurrencies; i++) {
+            if (i % 4 == 3 || i + 1 == numberOfCurrencies)
+                continue;
+            ledger.out << "convert " << (double) (1 + ledger.random.below(9)) << ledger.currencies[i] << " to "
+                       << ledger.random_amount() << ledger.currencies[i + 1] << '\n';
+        }
+    }
+
+    /**
+     * Every person has several aliases and the transactions use them.
+     */
+    void aliases(Ledger &ledger, usize people, usize transactions) {
+        ledger.define_currency();
+        for (usize i = 0; i < people; i++)
+            ledger.define_person(1 + ledger.random.below(5));
+
+        auto const any_name = [&ledger]() -> std::string const & {
+            usize person = ledger.random.below(ledger.people.size());
+            auto const &names = ledger.aliases[person];
+            usize which = ledger.random.below(names.size() + 1);
+            return which == names.size() ? ledger.people[person] : names[which];
+        };
+        for (usize i = 0; i < transactions; i++)
+            ledger.transaction({any_name()}, ledger.currencies[0], {any_name(), any_name()});
+    }
+
+    /**
+     * People are split into disjoint circles of five to twenty friends, transactions never leave the circle.
+     */
+    void circles(Ledger &ledger, usize people, usize transactions) {
+        ledger.define_currency();
+        for (usize i = 0; i < people; i++)
+            ledger.define_person();
+
+        // [first person, end) of every circle
+        std::vector<std::pair<usize, usize>> bounds;
+        std::vector<std::string> groups;
+        for (usize start = 0; start < people;) {
+            usize end = std::min(start + 5 + ledger.random.below(16), people);
+            bounds.emplace_back(start, end);
+            groups.push_back(ledger.define_group({ledger.people.begin() + start, ledger.people.begin() + end}));
+            start = end;
+        }
+
+        for (usize i = 0; i < transactions; i++) {
+            usize circle = ledger.random.below(bounds.size());
+            auto[start, end] = bounds[circle];
+            auto const &payer = ledger.people[start + ledger.random.below(end - start)];
+            if (ledger.random.chance(30))
+                ledger.transaction({payer}, ledger.currencies[0], {groups[circle]});
+            else
+                ledger.transaction({payer}, ledger.currencies[0], {ledger.people[start + ledger.random.below(end - start)]});
+        }
+    }
+
+    struct Profile {
+        std::function<void(Ledger &, usize, usize)> generate;
+        // fewer people would not make a valid ledger
+        usize minPeople;
+    };
+
+    const std::map<std::string, Profile> PROFILES = {
+            {"flat",          {flat,          1}},
+            {"definitions",   {definitions,   1}},
+            // the transactions need at least one group
+            {"nested-groups", {nested_groups, 2}},
+            {"big-groups",    {big_groups,    1}},
+            {"currencies",    {currencies,    1}},
+            {"aliases",       {aliases,       1}},
+            {"circles",       {circles,       1}},
+    };
+
+    /**
+     * @return the number written in decimal digits only, nothing for anything else
+     */
+    std::optional<usize> parse_count(const char *text) {
+        if (*text < '0' || *text > '9')
+            return std::nullopt;
+        char *end;
+        errno = 0;
+        auto value = std::strtoull(text, &end, 10);
+        if (*end != '\0' || errno == ERANGE)
+            return std::nullopt;
+        return value;
+    }
+}
+
+int main(int argc, char **argv) {
+    auto profile = argc >= 2 ? PROFILES.find(argv[1]) : PROFILES.end();
+    auto people = argc >= 3 ? parse_count(argv[2]) : std::nullopt;
+    auto transactions = argc >= 4 ? parse_count(argv[3]) : std::nullopt;
+    if (argc < 4 || argc > 5 || profile == PROFILES.end() || !people || !transactions) {
+        std::cerr << "Usage: " << argv[0] << " <profile> <people> <transactions> [seed]" << std::endl;
+        std::cerr << "Profiles:";
+        for (auto const &p : PROFILES)
+            std::cerr << ' ' << p.first;
+        std::cerr << std::endl;
+        return 1;
+    }
+    if (*people < profile->second.minPeople) {
+        std::cerr << "Profile " << profile->first << " needs at least " << profile->second.minPeople
+                  << (profile->second.minPeople == 1 ? " person" : " people") << std::endl;
+        return 1;
+    }
+
+    OutputWriter out(STDOUT_FILENO, 1 << 20);
+    Ledger ledger(out, argc == 5 ? std::strtoull(argv[4], nullptr, 10) : 0);
+    profile->second.generate(ledger, *people, *transactions);
+    return 0;
+}
@@ -1,6 +1,12 @@
 #include <gtest/gtest.h>
 #include "test_parser.h"
 #include "test_iterator.h"
+#include "test_conversions.h"
+#include "test_writer.h"
+#include "test_batch.h"
+#include "test_alloc.h"
+#include "test_trace.h"
+#include "test_server.h"
 
 int main(int argc, char **argv) {
   ::testing::InitGoogleTest(&argc, argv);
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <gtest/gtest.h>
+#include "alloc_tracker.h"
+#include "balancer.h"
+#include "parser.h"
+#include "simplifier.h"
+#include "types.h"
+#include <string>
+#include <vector>
+
+namespace {
+    struct ScopeUsage {
+        u64 allocations;
+        u64 bytes;
+    };
+
+    ScopeUsage usage_of(alloc::Scope scope) {
+        return {alloc::of(scope).allocations, alloc::of(scope).bytes};
+    }
+
+    /**
+     * @return allocations in the scope per line of the ledger
+     */
+    double per_line(alloc::Scope scope, ScopeUsage before, usize lines) {
+        return (double) (usage_of(scope).allocations - before.allocations) / lines;
+    }
+
+    std::vector<std::string> ledger(usize people, usize transactions) {
+        std::vector<std::string> lines = {"def currency czk"};
+        for (usize i = 0; i < people; i++)
+            lines.push_back("def person person" + std::to_string(i) + " p" + std::to_string(i));
+        lines.emplace_back("def group everybody p0 p1 p2 p3 p4 p5 p6 p7");
+        for (usize i = 0; i < transactions; i++)
+            lines.push_back("p" + std::to_string(i % people) + " paid " + std::to_string(i % 97 + 1) + "czk for p"
+                            + std::to_string((i * 7 + 3) % people) + (i % 10 == 0 ? " everybody" : ""));
+        return lines;
+    }
+}
+
+TEST(AllocTest, ScopesAttributeAllocations) {
+    auto registry = usage_of(alloc::Scope::registry);
+    auto output = usage_of(alloc::Scope::output);
+    i64 live = alloc::of(alloc::Scope::registry).live;
+    {
+        ALLOC_SCOPE(registry);
+        std::vector<u64> numbers(1000);
+        {
+            ALLOC_SCOPE(output);
+            std::vector<u64> nested(10);
+        }
+        ASSERT_EQ(alloc::of(alloc::Scope::registry).live, live + (i64) (1000 * sizeof(u64)));
+    }
+
+    ASSERT_EQ(usage_of(alloc::Scope::registry).allocations, registry.allocations + 1);
+    ASSERT_EQ(usage_of(alloc::Scope::registry).bytes, registry.bytes + 1000 * sizeof(u64));
+    ASSERT_EQ(usage_of(alloc::Scope::output).allocations, output.allocations + 1);
+    // freed memory is returned to the scope which allocated it
+    ASSERT_EQ(alloc::of(alloc::Scope::registry).live, live);
+    ASSERT_GE(alloc::of(alloc::Scope::registry).peak, live + (i64) (1000 * sizeof(u64)));
+}
+
+TEST(AllocTest, TrackedFunctionAllocatesInItsScope) {
+    auto simplifier = usage_of(alloc::Scope::simplifier);
+    auto f = alloc::tracked<alloc::Scope::simplifier>([](usize n) { return std::vector<char>(n); });
+    ASSERT_EQ(f(10).size(), 10);
+    ASSERT_EQ(usage_of(alloc::Scope::simplifier).allocations, simplifier.allocations + 1);
+}
+
+/**
+ * Budgets of allocations per line of a typical ledger. They are set with some margin above the current state, so
+ * they fail only on a real regression, e.g. a copy of every token.
+ */
+TEST(AllocTest, PipelineAllocationBudget) {
+    const usize people = 200;
+    auto lines = ledger(people, 5000);
+    auto parser = usage_of(alloc::Scope::parser);
+    auto registry = usage_of(alloc::Scope::registry);
+    auto balancer = usage_of(alloc::Scope::balancer);
+
+    BalancingState state;
+    for (auto const &line : lines)
+        advance_state(line_parser(token_splitter(line)), state);
+    settle(state);
+
+    // tokens of a line and the parsed element
+    ASSERT_LE(per_line(alloc::Scope::parser, parser, lines.size()), 8.);
+    // the name and the alias of a person are stored once in a hash map
+    ASSERT_LE(per_line(alloc::Scope::registry, registry, people), 4.);
+    // debt vectors are dense and grow geometrically, a transaction alone does not allocate
+    ASSERT_LE(per_line(alloc::Scope::balancer, balancer, lines.size()), 0.05);
+
+    auto simplifier = usage_of(alloc::Scope::simplifier);
+    usize transactions = 0;
+    {
+        ALLOC_SCOPE(simplifier);
+        for (auto &[currency, debts] : state.currencies) {
+            auto[ids, debtVector] = debts.nonzero();
+            SimplifiedTransactionGenerator::create(std::move(ids), std::move(debtVector))
+                    .into([&transactions](SimpleTransaction) { transactions++; });
+        }
+    }
+    ASSERT_GT(transactions, 0);
+    ASSERT_LE(usage_of(alloc::Scope::simplifier).allocations - simplifier.allocations, 64);
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <gtest/gtest.h>
+#include "balancer.h"
+#include "batch.h"
+#include "debts.h"
+#include "types.h"
+#include <array>
+#include <cfloat>
+#include <cmath>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+    constexpr usize BATCH_PEOPLE = 100000;
+
+    DebtVector dense_debts() {
+        DebtVector debts;
+        for (usize id = 0; id < BATCH_PEOPLE; id++)
+            debts.add(id, 1. / (double) (id + 1));
+        return debts;
+    }
+}
+
+TEST(BatchTest, ParallelFlushIsExact) {
+    // only the batch itself is exact, the whole balancer sums the shares of groups in another order, see `settle`
+    // and `BalancesWithinTolerance`
+    // well above the threshold of the parallel flush, the amounts don't add up exactly in a different order
+    std::mt19937_64 random(7);
+    std::vector<std::pair<person_id_t, double>> changes;
+    for (usize i = 0; i < 300000; i++)
+        changes.emplace_back(random() % BATCH_PEOPLE, (double) (random() % 1000000) / 7.);
+
+    DebtVector immediate = dense_debts();
+    for (auto[id, delta] : changes)
+        immediate.add(id, delta);
+
+    for (usize threads : {1, 2, 4, 7}) {
+        DebtVector debts = dense_debts();
+        ASSERT_TRUE(debts.is_dense());
+        TransactionBatch<DebtVector> batch(changes.size() + 1, threads);
+        for (auto[id, delta] : changes)
+            batch.add(debts, std::array{id}, delta);
+        batch.flush();
+
+        ASSERT_EQ(debts.size(), immediate.size());
+        for (usize id = 0; id < debts.size(); id++)
+            ASSERT_EQ(debts.data()[id], immediate.data()[id]) << "threads " << threads << ", person " << id;
+    }
+}
+
+TEST(BatchTest, BalancesWithinTolerance) {
+    constexpr usize people = 200;
+    constexpr usize groups = 20;
+    BalancingState state;
+    auto const apply = [&state](std::string const &line) { advance_state(line_parser(token_splitter(line)), state); };
+    apply("def currency czk");
+    for (usize i = 0; i < people; i++)
+        apply("def person p" + std::to_string(i));
+
+    // overlapping groups of ten people
+    std::vector<std::vector<person_id_t>> members(groups);
+    for (usize g = 0; g < groups; g++) {
+        std::string line = "def group g" + std::to_string(g);
+        for (usize j = 0; j < 10; j++) {
+            members[g].push_back((g * 7 + j * 13) % people);
+            line += " p" + std::to_string(members[g].back());
+        }
+        apply(line);
+    }
+
+    // every share added to its person right away, with the number of shares and their absolute sum
+    std::vector<double> sequential(people, 0.), absolute(people, 0.);
+    std::vector<usize> added(people, 0);
+    auto const add = [&](person_id_t id, double amount) {
+        sequential[id] += amount;
+        absolute[id] += std::abs(amount);
+        added[id]++;
+    };
+
+    std::mt19937_64 random(3);
+    for (usize i = 0; i < 20000; i++) {
+        usize payer = random() % people;
+        usize group = random() % groups;
+        // the amounts are parsed from the line, so they go through the same text round trip
+        std::string amount = std::to_string(random() % 1000000) + "." + std::to_string(random() % 100);
+        apply("p" + std::to_string(payer) + " paid " + amount + "czk for g" + std::to_string(group));
+        double value = std::stod(amount);
+        for (auto id : members[group])
+            add(id, value / (double) members[group].size());
+        add(payer, -value);
+    }
+    settle(state);
+
+    auto[ids, balances] = state.currencies.at("czk").nonzero();
+    std::vector<double> result(people, 0.);
+    for (usize i = 0; i < ids.size(); i++)
+        result[ids[i]] = balances[i];
+    for (usize id = 0; id < people; id++) {
+        // the bound stated at `settle`
+        double tolerance = 2. * (double) added[id] * (DBL_EPSILON / 2.) * absolute[id];
+        ASSERT_NEAR(result[id], sequential[id], tolerance) << "person " << id;
+    }
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <gtest/gtest.h>
+#include "balancer.h"
+#include "conversions.h"
+#include "parser.h"
+#include "types.h"
+#include <string>
+#include <vector>
+
+namespace {
+    BalancingState apply_lines(std::vector<std::string> const &lines) {
+        BalancingState state;
+        for (auto const &line : lines)
+            advance_state(line_parser(token_splitter(line)), state);
+        return state;
+    }
+
+    std::vector<std::string> three_people() {
+        return {"def currency czk", "def currency eur", "def person a", "def person b", "def person c"};
+    }
+}
+
+TEST(ConversionTest, ChainResolution) {
+    ConversionGraph graph;
+    graph.add("eur", 25., "czk");
+    graph.add("usd", 0.5, "eur");
+    graph.add("gbp", 2., "usd");
+
+    ASSERT_EQ(graph.resolve("czk"), std::make_pair(1., std::string("czk")));
+    ASSERT_EQ(graph.resolve("eur"), std::make_pair(25., std::string("czk")));
+    ASSERT_EQ(graph.resolve("usd"), std::make_pair(12.5, std::string("czk")));
+    ASSERT_EQ(graph.resolve("gbp"), std::make_pair(25., std::string("czk")));
+    ASSERT_TRUE(graph.is_converted("usd"));
+    ASSERT_FALSE(graph.is_converted("czk"));
+}
+
+TEST(ConversionTest, CompositeRatesAppliedAtSettlement) {
+    auto lines = three_people();
+    lines.insert(lines.end(), {"def currency usd",
+                               "a paid 4eur for b",
+                               "convert 1eur to 25czk",
+                               "b paid 10usd for c",
+                               "convert 2usd to 1eur",
+                               "c paid 2usd for a"});
+    auto state = apply_lines(lines);
+    settle(state);
+
+    ASSERT_EQ(state.currencies.count("eur"), 0);
+    ASSERT_EQ(state.currencies.count("usd"), 0);
+    ASSERT_EQ(state.currencies.at("czk").nonzero(),
+              std::make_pair(std::vector<person_id_t>{0, 1, 2}, std::vector<double>{-75., -25., 100.}));
+}
+
+TEST(ConversionTest, CycleMovesBalancesEagerly) {
+    ConversionGraph graph;
+    graph.add("czk", 0.04, "eur");
+    ASSERT_TRUE(graph.closes_cycle("eur", "czk"));
+    ASSERT_THROW(graph.add("eur", 25., "czk"), std::logic_error);
+
+    auto lines = three_people();
+    lines.insert(lines.end(), {"a paid 100czk for b",
+                               "b paid 10eur for c",
+                               "convert 1czk to 0.04eur",
+                               "c paid 40eur for a",
+                               "convert 1eur to 25czk",
+                               "a paid 30czk for c"});
+    auto state = apply_lines(lines);
+    settle(state);
+
+    // the chain is closed into `czk`, its balance is a plain one again
+    ASSERT_EQ(state.currencies.count("eur"), 0);
+    auto[ids, balances] = state.currencies.at("czk").nonzero();
+    ASSERT_EQ(ids, (std::vector<person_id_t>{0, 1, 2}));
+    ASSERT_NEAR(balances[0], 870., 1e-9);
+    ASSERT_NEAR(balances[1], -150., 1e-9);
+    ASSERT_NEAR(balances[2], -720., 1e-9);
+    ASSERT_TRUE(state.conversions.is_converted("czk"));
+    ASSERT_TRUE(state.conversions.is_converted("eur"));
+}
+
+TEST(ConversionTest, DuplicateConversionThrows) {
+    auto lines = three_people();
+    lines.emplace_back("convert 1eur to 25czk");
+    auto state = apply_lines(lines);
+    ASSERT_THROW(advance_state(line_parser(token_splitter("convert 1eur to 24czk")), state), std::logic_error);
+}
+
+TEST(ConversionTest, ConversionIntoItselfThrows) {
+    auto lines = three_people();
+    lines.emplace_back("a paid 10czk for b");
+    auto state = apply_lines(lines);
+    ASSERT_THROW(advance_state(line_parser(token_splitter("convert 1czk to 2czk")), state), std::logic_error);
+
+    // nothing was recorded, the currency can still be converted
+    ASSERT_FALSE(state.conversions.is_converted("czk"));
+    advance_state(line_parser(token_splitter("convert 1czk to 0.04eur")), state);
+    settle(state);
+    ASSERT_EQ(state.currencies.at("eur").nonzero(),
+              std::make_pair(std::vector<person_id_t>{0, 1}, std::vector<double>{-0.4, 0.4}));
+}
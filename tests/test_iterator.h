@@ -2,7 +2,15 @@
 
 #include <gtest/gtest.h>
 #include "iterator.h"
+#include "generator.h"
+#include "parser.h"
 #include "types.h"
+#include "alloc_tracker.h"
+#include <atomic>
+#include <chrono>
+#include <set>
+#include <sstream>
+#include <string>
 
 TEST(IteratorTest, RangeFilterMapFold) {
     auto const filter = [](usize a) { return a % 7 == 0; };
@@ -32,6 +40,17 @@ TEST(IteratorTest, FoldStatePassing) {
     );
 }
 
+TEST(IteratorTest, FoldMutInPlace) {
+    auto constexpr pusher = [](usize a, std::vector<usize> &state) { state.push_back(a); };
+    auto initial_data = std::vector<usize>{111};
+    initial_data.reserve(11);
+    auto const *data = initial_data.data();
+
+    auto result = Iter::range(10).fold_mut(pusher, std::move(initial_data));
+    ASSERT_EQ(result, (std::vector<usize>{111, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9}));
+    ASSERT_EQ(result.data(), data);
+}
+
 TEST(IteratorTest, ZipIterator) {
     auto constexpr mapper = [](auto pair) { return pair.first; };
     ASSERT_EQ(Iter::range(100).enumerate().map(mapper).sum(), 4950);
@@ -55,4 +74,354 @@ TEST(IteratorTest, ClassicalIteratorCompatibility2) {
         accum += i;
     }
     ASSERT_EQ(accum, 45);
-}
\ No newline at end of file
+}
+
+TEST(IteratorTest, BatchProtocolDetection) {
+    ASSERT_TRUE(has_next_batch<decltype(Iter::range(10))>::value);
+    auto constexpr identity = [](usize a) { return a; };
+    ASSERT_TRUE(has_next_batch<decltype(Iter::range(10).map(identity))>::value);
+    ASSERT_FALSE(has_next_batch<decltype(Iter::stdin_by_lines())>::value);
+}
+
+TEST(IteratorTest, BatchProtocolMatchesNext) {
+    auto const filter = [](usize a) { return a % 3 != 0; };
+    auto const map = [](usize a) { return a * 2; };
+
+    std::vector<usize> expected;
+    auto it = Iter::range(1000).filter(filter).map(map).take(500);
+    while (auto a = it.next()) expected.push_back(*a);
+
+    ASSERT_EQ(Iter::range(1000).filter(filter).map(map).take(500).collect(), expected);
+    ASSERT_EQ(Iter::range(1000).filter(filter).map(map).take(500).fold(
+            [](usize a, std::vector<usize> s) { s.push_back(a); return s; }, std::vector<usize>{}), expected);
+}
+
+TEST(IteratorTest, BatchProtocolPartialBlocks) {
+    auto it = Iter::range(300).enumerate();
+    std::vector<std::pair<usize, usize>> block(256);
+    ASSERT_EQ(it.next_batch(Span(block.data(), block.size())), 256);
+    ASSERT_EQ(block[255], (std::pair<usize, usize>{255, 255}));
+    ASSERT_EQ(it.next_batch(Span(block.data(), block.size())), 44);
+    ASSERT_EQ(it.next_batch(Span(block.data(), block.size())), 0);
+}
+
+TEST(IteratorTest, ParMapKeepsOrder) {
+    auto const map = [](usize a) { return a * a; };
+    std::vector<usize> expected = Iter::range(10000).map(map).collect();
+    ASSERT_EQ(Iter::range(10000).par_map(map, 4, 7).collect(), expected);
+}
+
+namespace {
+    struct CountingChunkHooks {
+        static inline std::atomic<usize> read{0};
+        static inline std::atomic<usize> mapped{0};
+
+        template<typename Read>
+        void on_read(Read &&f) {
+            read += f();
+        }
+
+        template<typename Map>
+        void on_map(usize size, Map &&f) {
+            f();
+            mapped += size;
+        }
+    };
+}
+
+TEST(IteratorTest, ParMapHooks) {
+    auto const map = [](usize a) { return a * a; };
+    std::vector<usize> expected = Iter::range(10000).map(map).collect();
+    ASSERT_EQ(Iter::range(10000).par_map<CountingChunkHooks>(map, 4, 7).collect(), expected);
+    ASSERT_EQ(CountingChunkHooks::read, 10000);
+    ASSERT_EQ(CountingChunkHooks::mapped, 10000);
+}
+
+TEST(IteratorTest, ParMapSingleThreadMapsInPlace) {
+    auto const map = [](usize a) { return a * a; };
+    std::vector<usize> expected = Iter::range(10000).map(map).collect();
+    CountingChunkHooks::read = 0;
+    ASSERT_EQ(Iter::range(10000).par_map<CountingChunkHooks>(map, 1, 7).collect(), expected);
+    // no chunks are handed over
+    ASSERT_EQ(CountingChunkHooks::read, 0);
+
+    usize read = 0;
+    auto it = Iter::count_from((usize) 0)
+            .lazy_for_each([&read](usize const &) { read++; })
+            .par_map(map, 1, 10);
+    ASSERT_EQ(it.take(5).collect(), (std::vector<usize>{0, 1, 4, 9, 16}));
+    ASSERT_EQ(read, 5);
+}
+
+TEST(IteratorTest, ParMapBoundedReadAhead) {
+    usize read = 0;
+    auto it = Iter::count_from((usize) 0)
+            .lazy_for_each([&read](usize const &) { read++; })
+            .par_map([](usize a) { return a + 1; }, 2, 10);
+    ASSERT_EQ(it.take(5).collect(), (std::vector<usize>{1, 2, 3, 4, 5}));
+    // read ahead chunks and the one being consumed
+    ASSERT_LE(read, (2 * 4 + 1) * 10);
+}
+
+TEST(IteratorTest, ParMapRethrowsInOrder) {
+    std::vector<usize> seen;
+    auto it = Iter::range(100).par_map([](usize a) {
+        if (a == 42) throw std::logic_error("42");
+        return a;
+    }, 3, 8);
+    ASSERT_THROW(while (auto a = it.next()) seen.push_back(*a), std::logic_error);
+    ASSERT_EQ(seen, Iter::range(42).collect());
+}
+
+TEST(IteratorTest, PipelineDoesNotCopy) {
+    const usize n = 10000;
+    std::vector<std::string> input;
+    for (usize i = 0; i < n; i++)
+        input.push_back(std::string(32, 'a' + i % 26) + std::to_string(i));
+
+    auto const keep = [](std::string const &s) { return s[0] != 'b'; };
+    auto const identity = [](std::string s) { return s; };
+
+    usize before = alloc::allocation_count();
+    auto result = Iter::from(std::move(input)).filter(keep).map(identity).filter(keep).collect();
+    usize allocations = alloc::allocation_count() - before;
+
+    ASSERT_EQ(result.size(), n - n / 26 - 1);
+    ASSERT_LE(allocations, n);
+}
+
+TEST(IteratorTest, MaxByDoesNotCopy) {
+    const usize n = 10000;
+    std::vector<std::string> input;
+    for (usize i = 0; i < n; i++)
+        input.push_back(std::string(32, 'a') + std::to_string(i));
+
+    usize before = alloc::allocation_count();
+    auto longest = Iter::from(std::move(input)).max_by([](std::string const &s) { return s.size(); });
+    usize allocations = alloc::allocation_count() - before;
+
+    ASSERT_EQ(*longest, std::string(32, 'a') + "1000");
+    ASSERT_EQ(allocations, 0);
+}
+
+TEST(IteratorTest, FilterLongRejectedRun) {
+    auto it = Iter::range(10000000).filter([](usize a) { return a == 9999999; });
+    ASSERT_EQ(it.next(), std::make_optional<usize>(9999999));
+    ASSERT_EQ(it.next(), std::nullopt);
+}
+
+TEST(IteratorTest, FilterBatchKeepsValues) {
+    std::vector<std::vector<int>> vectors{{1}, {2, 2}, {}, {3}, {4, 4}};
+    auto const nonempty = [](std::vector<int> const &v) { return !v.empty(); };
+    ASSERT_EQ(Iter::from(vectors).filter(nonempty).take(3).collect(),
+              (std::vector<std::vector<int>>{{1}, {2, 2}, {3}}));
+
+    std::vector<std::string> names{"anna", "bob", "", "cyril", "dana"};
+    auto const named = [](std::string const &s) { return !s.empty(); };
+    ASSERT_EQ(Iter::zip(Iter::from(names).filter(named), Iter::range(10)).collect(),
+              (std::vector<std::pair<std::string, usize>>{{"anna", 0}, {"bob", 1}, {"cyril", 2}, {"dana", 3}}));
+}
+
+TEST(IteratorTest, ContiguousReductions) {
+    for (usize n : {1, 2, 3, 7, 8, 9, 1000, 1003}) {
+        std::vector<double> values;
+        for (usize i = 0; i < n; i++)
+            values.push_back((double) ((i * 7919) % 101) - 50.);
+
+        ASSERT_TRUE(is_contiguous_iterator<ContiguousIterator<double>>::value);
+
+        auto const second = [](auto const &p) { return p.second; };
+        auto expectedMax = *Iter::range(n).map([&values](usize i) { return std::pair{i, values[i]}; }).max_by(second);
+        auto expectedMin = *Iter::range(n).map([&values](usize i) { return std::pair{i, values[i]}; }).min_by(second);
+
+        ASSERT_EQ(Iter::from(values).argmax(), expectedMax);
+        ASSERT_EQ(Iter::from(values).argmin(), expectedMin);
+        ASSERT_EQ(Iter::from(values).argminmax(), std::make_pair(expectedMin, expectedMax));
+        ASSERT_EQ(Iter::from(values).max(), expectedMax.second);
+        ASSERT_EQ(Iter::from(values).min(), expectedMin.second);
+        ASSERT_DOUBLE_EQ(Iter::from(values).sum(), Iter::from(values).fold([](double v, double s) { return v + s; }, 0.));
+    }
+}
+
+TEST(IteratorTest, SumKeepsValueType) {
+    std::vector<double> values{0.25, 0.5, 1.75};
+    auto const identity = [](double a) { return a; };
+    static_assert(std::is_same_v<decltype(Iter::from(values).sum()), double>);
+    static_assert(std::is_same_v<decltype(Iter::from(values).map(identity).sum()), double>);
+    ASSERT_EQ(Iter::from(values).sum(), 2.5);
+    ASSERT_EQ(Iter::from(values).map(identity).sum(), 2.5);
+    ASSERT_EQ(Iter::range(5).filter([](usize a) { return a % 2 == 0; }).sum(), (usize) 6);
+}
+
+TEST(IteratorTest, GenericMinMax) {
+    auto const mod = [](usize a) { return (a * 37) % 11; };
+    ASSERT_EQ(Iter::range(100).map(mod).argminmax(), std::make_pair(std::pair<usize, usize>{0, 0}, std::pair<usize, usize>{8, 10}));
+    ASSERT_EQ(Iter::range(100).minmax_by(mod), std::make_pair((usize) 0, (usize) 8));
+    ASSERT_EQ(Iter::from(std::vector<double>{}).argminmax(), std::nullopt);
+}
+
+TEST(IteratorTest, PushProtocolDetection) {
+    std::vector<double> values{1, 2, 3};
+    std::vector<std::string> names{"a"};
+    auto const twice = [](double a) { return a * 2; };
+    auto const positive = [](double a) { return a > 0; };
+    ASSERT_TRUE(has_push_all<decltype(Iter::from(values).map(twice).filter(positive))>::value);
+    ASSERT_TRUE(has_push_all<decltype(Iter::from(names))>::value);
+    ASSERT_FALSE(has_push_all<decltype(Iter::range(10).map(twice))>::value);
+    ASSERT_FALSE(has_push_all<decltype(Iter::from(values).take(2))>::value);
+}
+
+TEST(IteratorTest, FusedPipeline) {
+    std::vector<double> values;
+    for (usize i = 0; i < 100000; i++)
+        values.push_back((double) (i % 1000) - 500.);
+
+    auto const square = [](double a) { return a * a; };
+    auto const small = [](double a) { return a < 1000.; };
+    auto const add = [](double a, double s) { return a + s; };
+    auto const fused = [&]() { return Iter::from(values).map(square).filter(small).fold(add, 0.); };
+    auto const manual = [&]() {
+        double s = 0.;
+        for (double v : values)
+            if (v * v < 1000.)
+                s = v * v + s;
+        return s;
+    };
+    ASSERT_EQ(fused(), manual());
+
+    const std::vector<double> constValues = values;
+    ASSERT_EQ(Iter::from(constValues).map(square).filter(small).collect().size(), 63 * 100);
+}
+
+TEST(IteratorTest, SizeHint) {
+    std::vector<std::string> names{"a", "b", "c"};
+    ASSERT_EQ(Iter::range(10, 20).size_hint(), size_hint_t(10, 10));
+    ASSERT_EQ(Iter::range(10).map([](usize a) { return a * 2; }).size_hint(), size_hint_t(10, 10));
+    ASSERT_EQ(Iter::range(10).filter([](usize a) { return a % 2 == 0; }).size_hint(), size_hint_t(0, 10));
+    ASSERT_EQ(Iter::zip(Iter::range(10), Iter::from(names)).size_hint(), size_hint_t(3, 3));
+    ASSERT_EQ(Iter::count_from(0).take(5).size_hint(), size_hint_t(5, 5));
+    ASSERT_EQ(Iter::count_from(0).size_hint().second, std::nullopt);
+    ASSERT_EQ(Iter::stdin_by_lines().size_hint(), size_hint_t(0, std::nullopt));
+
+    auto it = Iter::range(10);
+    it.next();
+    ASSERT_EQ(it.size_hint(), size_hint_t(9, 9));
+}
+
+TEST(IteratorTest, LendingLines) {
+    auto const owned = [](std::string_view line) { return std::string(line); };
+    auto const trim = [](std::string_view line) { return line.substr(0, 2); };
+    using Lines = I<LendingLineIterator<std::istringstream>>;
+    ASSERT_TRUE(is_lending<Lines>::value);
+    ASSERT_TRUE(is_lending<decltype(std::declval<Lines>().filter(empty_filter).map(trim))>::value);
+    ASSERT_FALSE(is_lending<decltype(std::declval<Lines>().map(owned))>::value);
+    ASSERT_FALSE(is_lending<decltype(Iter::stdin_by_lines())>::value);
+
+    std::string input;
+    for (usize i = 0; i < 1000; i++)
+        input += "line " + std::to_string(i) + "\n";
+    auto lines = I(LendingLineIterator(std::istringstream(input))).filter(empty_filter);
+
+    usize count = 0;
+    usize before = alloc::allocation_count();
+    while (auto line = lines.next()) {
+        ASSERT_EQ(*line, "line " + std::to_string(count));
+        count++;
+        if (count == 10)
+            before = alloc::allocation_count();
+    }
+    ASSERT_EQ(count, 1000);
+    // the buffer may grow once the numbers get longer
+    ASSERT_LE(alloc::allocation_count() - before, 1);
+}
+
+TEST(IteratorTest, ParMapOverLendingLines) {
+    std::string input;
+    for (usize i = 0; i < 5000; i++)
+        input += std::to_string(i) + " x\n";
+
+    auto tokens = I(LendingLineIterator(std::istringstream(input)))
+            .par_map(token_splitter, 3, 64)
+            .filter(empty_filter)
+            .map([](std::vector<std::string> t) { return std::stoul(t[0]); })
+            .collect();
+    ASSERT_EQ(tokens, Iter::range(5000).collect());
+}
+
+TEST(IteratorTest, CollectAllocatesOnce) {
+    std::vector<std::string> names(1000, std::string(100, 'x'));
+    usize before = alloc::allocation_count();
+    auto pairs = Iter::zip(Iter::range(names.size()), Iter::from(names)).collect();
+    // the result is allocated once, the rest are the internal batch buffers
+    ASSERT_LE(alloc::allocation_count() - before, 1 + 4);
+    ASSERT_EQ(pairs.size(), names.size());
+    ASSERT_EQ(pairs.capacity(), names.size());
+
+    std::vector<usize> values{1, 2};
+    Iter::range(3, 1003).collect_into(values);
+    ASSERT_EQ(values.size(), 1002);
+    ASSERT_EQ(values.capacity(), 1002);
+
+    std::set<usize> unique;
+    Iter::range(100).map([](usize a) { return a % 10; }).collect_into(unique);
+    ASSERT_EQ(unique.size(), 10);
+}
+
+#ifdef FINANCNIDLO_COROUTINES
+
+#include <fcntl.h>
+#include <thread>
+
+namespace {
+    generator<usize> squares(usize n) {
+        for (usize i = 0; i < n; i++)
+            co_yield i * i;
+    }
+
+    generator<std::string> failing() {
+        co_yield std::string("ok");
+        throw std::logic_error("failed");
+    }
+}
+
+TEST(IteratorTest, CoroutineGenerator) {
+    ASSERT_TRUE(is_iterator<generator<usize>>::value);
+    ASSERT_EQ(I(squares(10)).filter([](usize a) { return a % 2 == 0; }).collect(),
+              (std::vector<usize>{0, 4, 16, 36, 64}));
+    ASSERT_EQ(I(squares(1000000)).take(3).collect(), (std::vector<usize>{0, 1, 4}));
+}
+
+TEST(IteratorTest, CoroutineGeneratorRethrows) {
+    auto it = I(failing());
+    ASSERT_EQ(it.next(), std::make_optional<std::string>("ok"));
+    ASSERT_THROW(it.next(), std::logic_error);
+    ASSERT_EQ(it.next(), std::nullopt);
+}
+
+TEST(IteratorTest, CoroutineGeneratorNoAllocationPerItem) {
+    auto it = I(squares(100000));
+    usize before = alloc::allocation_count();
+    ASSERT_EQ(it.fold([](usize a, usize s) { return a + s; }, (usize) 0), 333328333350000);
+    ASSERT_EQ(alloc::allocation_count() - before, 0);
+}
+
+TEST(IteratorTest, AsyncGeneratorWaitsForData) {
+    int fds[2];
+    ASSERT_EQ(pipe(fds), 0);
+    fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+
+    std::thread writer([fd = fds[1]]() {
+        for (const char *chunk : {"first li", "ne\nsecond", " line\n", "third"}) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            ASSERT_GT(write(fd, chunk, strlen(chunk)), 0);
+        }
+        close(fd);
+    });
+
+    auto lines = I(read_lines(fds[0])).collect();
+    writer.join();
+    close(fds[0]);
+    ASSERT_EQ(lines, (std::vector<std::string>{"first line", "second line", "third"}));
+}
+
+#endif
\ No newline at end of file
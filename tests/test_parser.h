@@ -4,6 +4,8 @@
 #include "parser.h"
 #include <vector>
 #include <string>
+#include <sstream>
+#include <cstdio>
 
 TEST(ParserTest, TokenSplitterEmptyString) {
     auto e = std::vector<std::string>{};
@@ -73,3 +75,47 @@ TEST(ParserTest, TransactionParser4) { ASSERT_ANY_THROW(line_parser({"a", "paid"
 TEST(ParserTest, TransactionParser5) { ASSERT_ANY_THROW(line_parser({"a", "paid", "usd", "for", "b"})); }
 
 TEST(ParserTest, TransactionParser6) { ASSERT_ANY_THROW(line_parser({"a", "paid", "5", "for", "b"})); }
+
+TEST(ParserTest, WriterMatchesStreams) {
+    std::ostringstream expected;
+    std::FILE *file = std::tmpfile();
+    {
+        // tiny buffer, so that it's flushed in the middle of the values
+        OutputWriter out(fileno(file), 16);
+        for (double v : {0., 5., 244.66666666666666, 31.666666666666668, 1e-7, 123456789., -0.5, 1e300}) {
+            out << v << "usd\n";
+            expected << v << "usd\n";
+        }
+        auto conversion = std::get<model::CurrencyTransformation>(line_parser({"convert", "1.5eur", "to", "26czk"}));
+        out << conversion << '\n' << model::Person("a", {"b", "c"}) << '\n' << std::string(100, 'x') << '\n';
+        expected << conversion << '\n' << model::Person("a", {"b", "c"}) << '\n' << std::string(100, 'x') << '\n';
+    }
+
+    std::string written(expected.str().size() + 1, '\0');
+    std::rewind(file);
+    written.resize(std::fread(written.data(), 1, written.size(), file));
+    std::fclose(file);
+    ASSERT_EQ(written, expected.str());
+}
+
+TEST(ParserTest, DefinitionsPrintedFromParsedLines) {
+    std::FILE *file = std::tmpfile();
+    std::ostringstream expected;
+    {
+        OutputWriter out(fileno(file));
+        for (auto line : {"def   person  John j\tjb ", "def group all jb g", "def currency usd", "convert 1.50eur to 26czk",
+                          "John paid 5usd for all"}) {
+            print_definitions(out)(line_parser(token_splitter(line)));
+            print_definitions(expected)(line_parser(token_splitter(line)));
+        }
+        // an invalid definition fails to parse before anything is printed
+        ASSERT_THROW(print_definitions(out)(line_parser(token_splitter("def animal Rex"))), std::logic_error);
+    }
+
+    std::string written(expected.str().size() + 1, '\0');
+    std::rewind(file);
+    written.resize(std::fread(written.data(), 1, written.size(), file));
+    std::fclose(file);
+    ASSERT_EQ(written, expected.str());
+    ASSERT_EQ(written, "def person John j jb\ndef group all jb g\ndef currency usd\nconvert 1.5eur to 26czk\n");
+}
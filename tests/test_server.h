@@ -0,0 +1,206 @@
+#pragma once
+
+#include <gtest/gtest.h>
+#include "server.h"
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+    /**
+     * Connection to a `LedgerServer`, sends a request and reads the whole answer.
+     */
+    class LedgerClient {
+    private:
+        int fd;
+        std::string received;
+
+        std::string read_line() {
+            char buffer[256];
+            while (received.find('\n') == std::string::npos) {
+                isize n = read(fd, buffer, sizeof(buffer));
+                if (n <= 0)
+                    throw std::runtime_error("connection closed");
+                received.append(buffer, n);
+            }
+            auto end = received.find('\n');
+            auto line = received.substr(0, end);
+            received.erase(0, end + 1);
+            return line;
+        }
+
+    public:
+        explicit LedgerClient(std::string const &path) : fd{socket(AF_UNIX, SOCK_STREAM, 0)} {
+            sockaddr_un address{};
+            address.sun_family = AF_UNIX;
+            std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+            if (connect(fd, (sockaddr *) &address, sizeof(address)) < 0)
+                throw std::runtime_error("can't connect");
+        }
+
+        LedgerClient(LedgerClient &other) = delete;
+
+        /**
+         * Fail the reads that wait longer than the given time instead of waiting forever.
+         */
+        void set_timeout(long seconds) {
+            timeval timeout{seconds, 0};
+            setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        }
+
+        ~LedgerClient() {
+            close(fd);
+        }
+
+        void send(std::string const &request) {
+            auto line = request + "\n";
+            ASSERT_EQ(write(fd, line.data(), line.size()), (isize) line.size());
+        }
+
+        std::string request(std::string const &request) {
+            send(request);
+            return read_line();
+        }
+
+        /**
+         * @return lines of the answer to `settle` without the final `end`
+         */
+        std::vector<std::string> settle(std::string const &currency = "") {
+            send(currency.empty() ? "settle" : "settle " + currency);
+            std::vector<std::string> lines;
+            for (auto line = read_line(); line != "end"; line = read_line())
+                lines.push_back(line);
+            return lines;
+        }
+    };
+
+    BalancingState ledger_state(std::vector<std::string> const &lines) {
+        BalancingState state;
+        for (auto const &line : lines)
+            advance_state(line_parser(token_splitter(line)), state);
+        return state;
+    }
+
+    /**
+     * Settle the whole ledger at once, the same way as the program does without the server. The amounts in the tests
+     * are whole numbers, so the shares of groups summed between other settlements than here add up exactly.
+     * @return simplified transactions of the currency, or of all currencies sorted by their names
+     */
+    std::vector<std::string> one_shot(std::vector<std::string> const &lines, std::string const &only = "") {
+        auto state = ledger_state(lines);
+        settle(state);
+        std::map<std::string, DebtVector const *> currencies;
+        for (auto const &[currency, debts] : state.currencies)
+            if (only.empty() || currency == only)
+                currencies[currency] = &debts;
+
+        std::string text;
+        {
+            OutputWriter out(text);
+            for (auto const &[currency, debts] : currencies) {
+                auto[ids, debtVector] = debts->nonzero();
+                SimplifiedTransactionGenerator::create(std::move(ids), std::move(debtVector))
+                        .into([&](SimpleTransaction st) { st.write_to(out, state.people, currency); });
+            }
+        }
+        std::vector<std::string> result;
+        for (usize start = 0, end; (end = text.find('\n', start)) != std::string::npos; start = end + 1)
+            result.push_back(text.substr(start, end - start));
+        return result;
+    }
+}
+
+TEST(ServerTest, AnswersOverSocket) {
+    std::vector<std::string> lines = {
+            "def person A", "def person B", "def person C", "def group all A B C",
+            "def currency czk", "def currency eur",
+            "A paid 30czk for all", "B paid 10eur for C",
+    };
+    LedgerServer server(ledger_state(lines));
+    std::string path = "/tmp/financnidlo-test-" + std::to_string(getpid()) + ".sock";
+    server.listen(path);
+    std::thread serving([&server] { server.serve(); });
+
+    // the server must be stopped also when an assertion fails
+    auto const requests = [&path, &lines] {
+        LedgerClient client(path);
+        auto const add = [&client, &lines](std::string const &line) {
+            ASSERT_EQ(client.request("add " + line), "ok");
+            lines.push_back(line);
+        };
+
+        ASSERT_EQ(client.settle(), (std::vector<std::string>{
+                "A paid 10czk for B", "A paid 10czk for C", "B paid 10eur for C"}));
+        ASSERT_EQ(client.settle(), one_shot(lines));
+
+        // only the changed currency differs, the other one is answered from the cache
+        add("C paid 10czk for A");
+        ASSERT_EQ(client.settle(), one_shot(lines));
+        ASSERT_EQ(client.settle("eur"), one_shot(lines, "eur"));
+
+        // a rejected line does not change anything
+        ASSERT_EQ(client.request("add A paid 10czk for Nobody").rfind("error ", 0), 0);
+        ASSERT_EQ(client.request("add def person A").rfind("error ", 0), 0);
+        ASSERT_EQ(client.request("add A paid for B").rfind("error ", 0), 0);
+        ASSERT_EQ(client.request("add convert 1czk to 2czk"), "error currency \"czk\" can't be converted into itself");
+        ASSERT_EQ(client.request("what").rfind("error ", 0), 0);
+        ASSERT_EQ(client.settle("czk"), one_shot(lines, "czk"));
+
+        // definitions and conversions after a settlement, same as when the whole ledger is read at once
+        add("def person D");
+        add("convert 1eur to 2czk");
+        add("D paid 4eur for B");
+        ASSERT_EQ(client.settle(), (std::vector<std::string>{
+                "A paid 10czk for C", "D paid 8czk for C", "B paid 2czk for C"}));
+        ASSERT_EQ(client.settle(), one_shot(lines));
+        ASSERT_EQ(client.settle("eur").size(), 0);
+        ASSERT_EQ(client.request("settle usd"), "error currency \"usd\" is not defined");
+
+        // a conversion closing a cycle
+        add("B paid 6czk for all");
+        add("convert 2czk to 1eur");
+        add("A paid 3eur for C");
+        ASSERT_EQ(client.settle(), one_shot(lines));
+    };
+    requests();
+
+    LedgerClient other(path);
+    ASSERT_EQ(other.request("shutdown"), "ok");
+    serving.join();
+}
+
+TEST(ServerTest, StalledClientDoesNotBlockOthers) {
+    std::vector<std::string> lines = {"def currency czk", "def currency eur", "def person A", "def person B",
+                                      "A paid 1eur for B"};
+    for (usize i = 0; i < 5000; i++)
+        lines.push_back("def person p" + std::to_string(i));
+    for (usize i = 0; i + 1 < 5000; i++)
+        lines.push_back("p" + std::to_string(i) + " paid " + std::to_string(i + 1) + "czk for p" + std::to_string(i + 1));
+    LedgerServer server(ledger_state(lines));
+    std::string path = "/tmp/financnidlo-test-stall-" + std::to_string(getpid()) + ".sock";
+    server.listen(path);
+    std::thread serving([&server] { server.serve(); });
+
+    auto const requests = [&path, &lines] {
+        // asks for far more than the socket buffers hold and never reads it
+        LedgerClient stalled(path);
+        for (usize i = 0; i < 20; i++)
+            stalled.send("settle");
+
+        LedgerClient other(path);
+        other.set_timeout(10);
+        ASSERT_EQ(other.settle("eur"), one_shot(lines, "eur"));
+        ASSERT_EQ(other.request("add B paid 1eur for A"), "ok");
+        ASSERT_EQ(other.settle("eur").size(), 0);
+    };
+    requests();
+
+    LedgerClient other(path);
+    ASSERT_EQ(other.request("shutdown"), "ok");
+    serving.join();
+}
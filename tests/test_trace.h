@@ -0,0 +1,35 @@
+#pragma once
+
+#include <gtest/gtest.h>
+#include "trace.h"
+#include <sstream>
+#include <string>
+#include <thread>
+
+TEST(TraceTest, SpansAreWrittenAsChromeEvents) {
+    trace::start();
+    {
+        trace::Span span("outer \"span\"");
+        span.set_detail("a detail longer than the limit of forty characters");
+        span.set_count(42);
+        trace::Span skipped("too short", 1000000000);
+    }
+    std::thread([] { trace::Span span("on a worker"); }).join();
+    // later tests must not be traced
+    trace::stop();
+    { trace::Span span("after stop"); }
+
+    std::ostringstream out;
+    trace::write_chrome_json(out);
+    auto json = out.str();
+
+    ASSERT_NE(json.find("\"name\":\"outer \\\"span\\\"\",\"ph\":\"X\""), std::string::npos);
+    ASSERT_NE(json.find("\"detail\":\"a detail longer than the limit of forty\",\"count\":42"), std::string::npos);
+    ASSERT_EQ(json.find("too short"), std::string::npos);
+    ASSERT_EQ(json.find("after stop"), std::string::npos);
+    ASSERT_FALSE(trace::enabled());
+    // the worker has its own buffer and thread id
+    auto worker = json.find("\"name\":\"on a worker\",\"ph\":\"X\",\"pid\":1,\"tid\":");
+    ASSERT_NE(worker, std::string::npos);
+    ASSERT_NE(json[worker + std::string("\"name\":\"on a worker\",\"ph\":\"X\",\"pid\":1,\"tid\":").size()], '0');
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <gtest/gtest.h>
+#include "balancer.h"
+#include "iterator.h"
+#include "parser.h"
+#include "writer.h"
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+
+TEST(WriterTest, DefinitionsKeptOnError) {
+    const std::vector<std::vector<std::string>> ledgers = {
+            {"def person a", "def currency czk", "a paid 10czk for x", "def person b"},
+            {"def currency czk", "def currency eur", "convert 1eur to 25czk", "convert 1eur to 24czk"},
+    };
+    const std::vector<std::string> printed = {
+            "def person a\ndef currency czk\n",
+            "def currency czk\ndef currency eur\nconvert 1eur to 25czk\nconvert 1eur to 24czk\n",
+    };
+
+    for (usize i = 0; i < ledgers.size(); i++) {
+        int fds[2];
+        ASSERT_EQ(pipe(fds), 0);
+        // nothing written must not block the test
+        fcntl(fds[0], F_SETFL, O_NONBLOCK);
+        std::string written(256, '\0');
+        {
+            OutputWriter out(fds[1]);
+            // the same pipeline as the main program
+            auto const ingest = [&]() {
+                return Iter::from(ledgers[i])
+                        .map(token_splitter)
+                        .map(line_parser)
+                        .lazy_for_each(print_definitions(out))
+                        .fold_mut(advance_state, BalancingState());
+            };
+            EXPECT_THROW(flushed_on_error(out, ingest), std::logic_error);
+            // read while the writer is still alive, its destructor would flush it anyway
+            written.resize(std::max<isize>(read(fds[0], written.data(), written.size()), 0));
+        }
+        close(fds[0]);
+        close(fds[1]);
+        EXPECT_EQ(written, printed[i]);
+    }
+}